@@ -0,0 +1,475 @@
+#include <iostream>
+#include <kzg.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Closed-loop load generator: each client issues its next request as soon as
+// the previous one completes, against the library in-process or against a
+// "kzg-cli serve" endpoint.
+
+using namespace std::chrono;
+
+enum operation { COMMIT, PROVE, VERIFY, NUM_OPERATIONS };
+const char* OPERATION_NAMES[] = { "commit", "prove", "verify" };
+
+struct options {
+  int clients = 4;
+  double duration = 10;
+  double interval = 1;
+  int mix[NUM_OPERATIONS] = { 1, 2, 7 };
+  vector<int> blob_chunks = { 256, 1024, 4096 };
+  vector<int> windows = { 1, 16, 64 };
+  string target = "inproc";
+  string setup;
+  string shared;
+  string shared_digest;
+};
+
+string to_hex(const vector<uint8_t>& bytes) {
+  static const char digits[] = "0123456789abcdef";
+  string res(2 * bytes.size(), '0');
+  for (size_t i = 0; i < bytes.size(); i++) {
+    res[2 * i] = digits[bytes[i] >> 4];
+    res[2 * i + 1] = digits[bytes[i] & 15];
+  }
+  return res;
+}
+
+vector<uint8_t> from_hex(const string& s) {
+  vector<uint8_t> res;
+  for (size_t i = 0; i + 1 < s.size(); i += 2)
+    res.push_back(strtol(s.substr(i, 2).c_str(), NULL, 16));
+  return res;
+}
+
+// Requests carry raw data, commits and proofs are opaque serialized bytes
+class target {
+public:
+  virtual ~target() {}
+  virtual vector<uint8_t> commit(const vector<uint8_t>& data) = 0;
+  virtual vector<uint8_t> prove(const vector<uint8_t>& data, int chunk_offset, int chunk_length) = 0;
+  virtual bool verify(const vector<uint8_t>& commit, const vector<uint8_t>& proof, int chunk_offset, const vector<uint8_t>& window) = 0;
+};
+
+class inproc_target : public target {
+private:
+  kzg::trusted_setup& kzg;
+  kzg::workspace workspace;
+
+  kzg::poly interpolate(const vector<uint8_t>& data) {
+    kzg::blob blob = kzg::blob::from_bytes(data.data(), 0, data.size(), MAX_CHUNK_BYTES);
+    return kzg::poly::from_blob(blob, workspace);
+  }
+
+public:
+  inproc_target(kzg::trusted_setup& kzg) : kzg(kzg) {}
+
+  vector<uint8_t> commit(const vector<uint8_t>& data) override {
+    return kzg.create_commit(interpolate(data)).serialize();
+  }
+
+  vector<uint8_t> prove(const vector<uint8_t>& data, int chunk_offset, int chunk_length) override {
+    return kzg.create_proof(interpolate(data), chunk_offset, chunk_length, workspace).serialize();
+  }
+
+  bool verify(const vector<uint8_t>& commit_bytes, const vector<uint8_t>& proof_bytes, int chunk_offset, const vector<uint8_t>& window) override {
+    kzg::commit commit = kzg::commit::deserialize(commit_bytes);
+    kzg::proof proof = kzg::proof::deserialize(proof_bytes);
+    kzg::blob expected = kzg::blob::from_bytes(window.data(), chunk_offset * MAX_CHUNK_BYTES, window.size(), MAX_CHUNK_BYTES);
+    return kzg.verify_proof(commit, proof, expected, workspace);
+  }
+};
+
+// Speaks the line protocol of "kzg-cli serve" over one connection
+class server_target : public target {
+private:
+  int fd;
+  string buffer;
+
+  string request(const string& line) {
+    string out = line + "\n";
+    size_t done = 0;
+    while (done < out.size()) {
+      ssize_t n = write(fd, out.data() + done, out.size() - done);
+      if (n <= 0)
+        throw runtime_error("connection to server lost");
+      done += n;
+    }
+
+    size_t end;
+    char chunk[65536];
+    while ((end = buffer.find('\n')) == string::npos) {
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n <= 0)
+        throw runtime_error("connection to server lost");
+      buffer.append(chunk, n);
+    }
+
+    string response = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    if (response.compare(0, 6, "error ") == 0)
+      throw runtime_error(response.substr(6));
+    return response;
+  }
+
+public:
+  server_target(const string& endpoint) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == string::npos)
+      throw invalid_argument("target must be inproc or host:port");
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrs;
+    if (getaddrinfo(endpoint.substr(0, colon).c_str(), endpoint.substr(colon + 1).c_str(), &hints, &addrs) != 0)
+      throw runtime_error("could not resolve " + endpoint);
+
+    fd = -1;
+    for (addrinfo* a = addrs; a != NULL && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+      throw runtime_error("could not connect to " + endpoint);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  ~server_target() { close(fd); }
+
+  vector<uint8_t> commit(const vector<uint8_t>& data) override {
+    return from_hex(request("commit " + to_hex(data)));
+  }
+
+  vector<uint8_t> prove(const vector<uint8_t>& data, int chunk_offset, int chunk_length) override {
+    return from_hex(request("prove " + to_hex(data) + " " + to_string(chunk_offset) + " " + to_string(chunk_length)));
+  }
+
+  bool verify(const vector<uint8_t>& commit, const vector<uint8_t>& proof, int chunk_offset, const vector<uint8_t>& window) override {
+    return request("verify " + to_hex(commit) + " " + to_hex(proof) + " " + to_string(chunk_offset) + " " + to_hex(window)) == "1";
+  }
+};
+
+// A blob with its commitment and proofs for verify requests, prepared
+// through the target so that they match the setup it uses
+struct fixture {
+  int chunks;
+  vector<uint8_t> data;
+  vector<uint8_t> commit;
+
+  struct opening {
+    int chunk_offset;
+    vector<uint8_t> window;
+    vector<uint8_t> proof;
+  };
+  vector<opening> openings;
+};
+
+struct latency_sample {
+  uint8_t op;
+  bool ok;
+  int64_t end_us;
+  int64_t latency_us;
+};
+
+struct cpu_snapshot {
+  int64_t at_us;
+  double process_seconds;
+  uint64_t system_busy;
+  uint64_t system_total;
+};
+
+cpu_snapshot cpu_now(steady_clock::time_point start) {
+  cpu_snapshot res;
+  res.at_us = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  res.process_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+  // aggregate line of /proc/stat: user nice system idle iowait irq softirq steal
+  res.system_busy = res.system_total = 0;
+  ifstream stat("/proc/stat");
+  string cpu;
+  stat >> cpu;
+  for (int i = 0; i < 8; i++) {
+    uint64_t ticks = 0;
+    stat >> ticks;
+    res.system_total += ticks;
+    if (i != 3 && i != 4)
+      res.system_busy += ticks;
+  }
+  return res;
+}
+
+vector<int> parse_list(const string& s) {
+  vector<int> res;
+  stringstream fields(s);
+  string field;
+  while (getline(fields, field, ','))
+    res.push_back(stoi(field));
+  return res;
+}
+
+options parse_options(int argc, char* argv[]) {
+  options res;
+  for (int i = 1; i < argc; i++) {
+    string flag = argv[i];
+    if (i + 1 >= argc)
+      throw invalid_argument("missing value for " + flag);
+    string value = argv[++i];
+
+    if (flag == "--clients")
+      res.clients = stoi(value);
+    else if (flag == "--duration")
+      res.duration = stod(value);
+    else if (flag == "--interval")
+      res.interval = stod(value);
+    else if (flag == "--mix") {
+      vector<int> mix = parse_list(value);
+      if (mix.size() != NUM_OPERATIONS)
+        throw invalid_argument("--mix takes commit,prove,verify weights");
+      copy(mix.begin(), mix.end(), res.mix);
+    } else if (flag == "--chunks")
+      res.blob_chunks = parse_list(value);
+    else if (flag == "--window")
+      res.windows = parse_list(value);
+    else if (flag == "--target")
+      res.target = value;
+    else if (flag == "--setup")
+      res.setup = value;
+    else if (flag == "--shared")
+      res.shared = value;
+    else if (flag == "--shared-digest")
+      res.shared_digest = value;
+    else
+      throw invalid_argument("unknown option " + flag);
+  }
+
+  if (res.clients < 1 || res.duration <= 0 || res.interval <= 0 || res.blob_chunks.empty() || res.windows.empty())
+    throw invalid_argument("bad options");
+  if (!res.shared.empty() && res.shared_digest.size() != 64)
+    throw invalid_argument("--shared needs --shared-digest, the digest kzg-cli share writes to kzg_public.digest");
+  return res;
+}
+
+double percentile(vector<int64_t>& sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t i = min(sorted.size() - 1, (size_t) (p * sorted.size()));
+  return sorted[i] / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+  kzg::init();
+
+  options opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    cerr << "usage: loadgen [--clients N] [--duration SECONDS] [--interval SECONDS]" << endl;
+    cerr << "               [--mix COMMIT,PROVE,VERIFY] [--chunks N,...] [--window N,...]" << endl;
+    cerr << "               [--target inproc|HOST:PORT] [--setup FILE | --shared NAME --shared-digest HEX]" << endl;
+    return 2;
+  }
+
+  // the in-process setup covers the largest blob
+  unique_ptr<kzg::trusted_setup> setup;
+  int max_chunks = *max_element(opts.blob_chunks.begin(), opts.blob_chunks.end());
+  if (opts.target == "inproc") {
+    if (!opts.shared.empty())
+      setup.reset(new kzg::trusted_setup(kzg::trusted_setup::attach_shared(opts.shared, from_hex(opts.shared_digest))));
+    else if (!opts.setup.empty())
+      setup.reset(new kzg::trusted_setup(opts.setup));
+    else
+      setup.reset(new kzg::trusted_setup(max_chunks + 1));
+  }
+  ZZ_pContext context;
+  context.save();
+
+  auto make_target = [&]() -> unique_ptr<target> {
+    if (setup)
+      return unique_ptr<target>(new inproc_target(*setup));
+    return unique_ptr<target>(new server_target(opts.target));
+  };
+
+  mt19937_64 rng(42);
+  vector<fixture> fixtures;
+  {
+    unique_ptr<target> t = make_target();
+    for (int chunks : opts.blob_chunks) {
+      fixture f;
+      f.chunks = chunks;
+      f.data.resize(chunks * MAX_CHUNK_BYTES);
+      for (auto& byte : f.data)
+        byte = rng();
+      f.commit = t->commit(f.data);
+
+      for (int width : opts.windows) {
+        if (width > chunks)
+          continue;
+        for (int i = 0; i < 4; i++) {
+          fixture::opening o;
+          o.chunk_offset = rng() % (chunks - width + 1);
+          auto begin = f.data.begin() + o.chunk_offset * MAX_CHUNK_BYTES;
+          o.window.assign(begin, begin + width * MAX_CHUNK_BYTES);
+          o.proof = t->prove(f.data, o.chunk_offset, width);
+          f.openings.push_back(o);
+        }
+      }
+      if (f.openings.empty())
+        throw invalid_argument("no window fits a blob of " + to_string(chunks) + " chunks");
+      fixtures.push_back(f);
+    }
+  }
+
+  cout << "clients " << opts.clients << ", target " << opts.target << ", mix commit:prove:verify "
+       << opts.mix[COMMIT] << ":" << opts.mix[PROVE] << ":" << opts.mix[VERIFY] << endl;
+
+  steady_clock::time_point start = steady_clock::now();
+  steady_clock::time_point deadline = start + duration_cast<steady_clock::duration>(duration<double>(opts.duration));
+  vector<vector<latency_sample>> samples(opts.clients);
+  vector<string> errors(opts.clients);
+  std::atomic<uint64_t> completed(0);
+
+  vector<thread> clients;
+  for (int c = 0; c < opts.clients; c++) {
+    clients.push_back(thread([&, c]() {
+      if (setup)
+        context.restore();
+      mt19937_64 rng(1000 + c);
+      discrete_distribution<int> pick_op(opts.mix, opts.mix + NUM_OPERATIONS);
+
+      try {
+        unique_ptr<target> t = make_target();
+        while (steady_clock::now() < deadline) {
+          const fixture& f = fixtures[rng() % fixtures.size()];
+          const fixture::opening& o = f.openings[rng() % f.openings.size()];
+          int op = pick_op(rng);
+
+          auto op_start = steady_clock::now();
+          bool ok = true;
+          try {
+            if (op == COMMIT)
+              ok = t->commit(f.data) == f.commit;
+            else if (op == PROVE)
+              t->prove(f.data, o.chunk_offset, o.window.size() / MAX_CHUNK_BYTES);
+            else
+              ok = t->verify(f.commit, o.proof, o.chunk_offset, o.window);
+          } catch (const invalid_argument& e) {
+            ok = false;
+          }
+          auto op_end = steady_clock::now();
+
+          samples[c].push_back({ (uint8_t) op, ok,
+                                 duration_cast<microseconds>(op_end - start).count(),
+                                 duration_cast<microseconds>(op_end - op_start).count() });
+          completed++;
+        }
+      } catch (const exception& e) {
+        errors[c] = e.what();
+      }
+    }));
+  }
+
+  // CPU is sampled live, latencies are binned by completion time afterwards
+  vector<cpu_snapshot> cpu = { cpu_now(start) };
+  uint64_t last_completed = 0;
+  for (int i = 1; steady_clock::now() < deadline; i++) {
+    this_thread::sleep_until(min(deadline, start + duration_cast<steady_clock::duration>(duration<double>(i * opts.interval))));
+    cpu.push_back(cpu_now(start));
+    uint64_t done = completed;
+    cerr << "\r" << fixed << setprecision(1) << cpu.back().at_us / 1e6 << "s: " << done - last_completed << " requests" << flush;
+    last_completed = done;
+  }
+  cerr << endl;
+
+  for (auto& client : clients)
+    client.join();
+  for (const string& error : errors) {
+    if (!error.empty()) {
+      cerr << "client failed: " << error << endl;
+      return 1;
+    }
+  }
+
+  vector<latency_sample> all;
+  for (auto& s : samples)
+    all.insert(all.end(), s.begin(), s.end());
+
+  unsigned int cores = max(1u, thread::hardware_concurrency());
+  cout << endl << "    time |   req/s |  p50 ms |  p99 ms | proc cpu | sys cpu" << endl;
+  for (size_t i = 1; i < cpu.size(); i++) {
+    vector<int64_t> latencies;
+    for (const latency_sample& s : all) {
+      if (s.end_us > cpu[i - 1].at_us && s.end_us <= cpu[i].at_us)
+        latencies.push_back(s.latency_us);
+    }
+    sort(latencies.begin(), latencies.end());
+
+    double seconds = (cpu[i].at_us - cpu[i - 1].at_us) / 1e6;
+    double process = 100.0 * (cpu[i].process_seconds - cpu[i - 1].process_seconds) / (seconds * cores);
+    uint64_t total = cpu[i].system_total - cpu[i - 1].system_total;
+    double system = total == 0 ? 0 : 100.0 * (cpu[i].system_busy - cpu[i - 1].system_busy) / total;
+
+    cout << fixed << setprecision(1)
+         << setw(7) << cpu[i].at_us / 1e6 << "s | "
+         << setw(7) << latencies.size() / seconds << " | "
+         << setprecision(3)
+         << setw(7) << percentile(latencies, 0.50) << " | "
+         << setw(7) << percentile(latencies, 0.99) << " | "
+         << setprecision(1)
+         << setw(7) << process << "% | "
+         << setw(6) << system << "%" << endl;
+  }
+
+  double elapsed = cpu.back().at_us / 1e6;
+  cout << endl << "operation |  count | errors |   req/s |  p50 ms |  p90 ms |  p99 ms | p99.9 ms |  max ms" << endl;
+  for (int op = 0; op < NUM_OPERATIONS; op++) {
+    vector<int64_t> latencies;
+    int failed = 0;
+    for (const latency_sample& s : all) {
+      if (s.op != op)
+        continue;
+      latencies.push_back(s.latency_us);
+      failed += !s.ok;
+    }
+    if (latencies.empty())
+      continue;
+    sort(latencies.begin(), latencies.end());
+
+    cout << setw(9) << OPERATION_NAMES[op] << " | "
+         << setw(6) << latencies.size() << " | "
+         << setw(6) << failed << " | "
+         << fixed << setprecision(1) << setw(7) << latencies.size() / elapsed << " | "
+         << setprecision(3)
+         << setw(7) << percentile(latencies, 0.50) << " | "
+         << setw(7) << percentile(latencies, 0.90) << " | "
+         << setw(7) << percentile(latencies, 0.99) << " | "
+         << setw(8) << percentile(latencies, 0.999) << " | "
+         << setw(7) << latencies.back() / 1000.0 << endl;
+  }
+
+  return 0;
+}
@@ -11,5 +11,13 @@ using namespace BLS12381;
 using namespace BLS12381_BIG;
 
 #define MODBYTES_CURVE MODBYTES_B384_58
+#define BASEBITS_CURVE BASEBITS_B384_58
+#define NLEN_CURVE NLEN_B384_58
+#define ATE_BITS_CURVE ATE_BITS_BLS12381
+#define SEXTIC_TWIST_CURVE SEXTIC_TWIST_BLS12381
+#define SIGN_OF_X_CURVE SIGN_OF_X_BLS12381
+
+// Enables kzg::eip4844, which is only defined over BLS12-381
+#define KZG_CURVE_BLS12381
 
 #endif
@@ -11,5 +11,13 @@ using namespace BN158;
 using namespace BN158_BIG;
 
 #define MODBYTES_CURVE MODBYTES_B160_56
+#define BASEBITS_CURVE BASEBITS_B160_56
+#define NLEN_CURVE NLEN_B160_56
+#define ATE_BITS_CURVE ATE_BITS_BN158
+#define SEXTIC_TWIST_CURVE SEXTIC_TWIST_BN158
+#define SIGN_OF_X_CURVE SIGN_OF_X_BN158
+
+// Selects the lattice decomposition of G2 scalars for BN curves
+#define KZG_CURVE_BN
 
 #endif
@@ -11,5 +11,13 @@ using namespace BN254;
 using namespace BN254_BIG;
 
 #define MODBYTES_CURVE MODBYTES_B256_56
+#define BASEBITS_CURVE BASEBITS_B256_56
+#define NLEN_CURVE NLEN_B256_56
+#define ATE_BITS_CURVE ATE_BITS_BN254
+#define SEXTIC_TWIST_CURVE SEXTIC_TWIST_BN254
+#define SIGN_OF_X_CURVE SIGN_OF_X_BN254
+
+// Selects the lattice decomposition of G2 scalars for BN curves
+#define KZG_CURVE_BN
 
 #endif
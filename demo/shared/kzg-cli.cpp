@@ -6,6 +6,12 @@
 #include <iomanip>
 #include <chrono>
 #include <iterator>
+#include <memory>
+#include <thread>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace std::chrono;
 
@@ -16,53 +22,112 @@ string to_hex(vector<uint8_t>& bytes) {
   return ss.str();
 }
 
-vector<uint8_t> from_hex(string s) {
-  vector<uint8_t> res;
-  for (int i = 0; i < s.size(); i += 2) {
-    string hex_byte = s.substr(i, 2);
-    res.push_back(strtol(hex_byte.c_str(), NULL, 16));
-  }
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return 0;
+}
+
+vector<uint8_t> from_hex(const string& s) {
+  vector<uint8_t> res(s.size() / 2);
+  for (size_t i = 0; i < res.size(); i++)
+    res[i] = (hex_digit(s[2 * i]) << 4) | hex_digit(s[2 * i + 1]);
   return res;
 }
 
+// Digest of the setup written by the share command, the shared segment must match it
+static const string SHARED_DIGEST_FILE = "../shared/kzg_public.digest";
+
+vector<uint8_t> shared_digest() {
+  ifstream file(SHARED_DIGEST_FILE);
+  string digest;
+  if (!(file >> digest))
+    throw runtime_error("no " + SHARED_DIGEST_FILE + ", run kzg-cli share first");
+  return from_hex(digest);
+}
+
+// Fixed-base table written by the precompute command, used when present
+static const string PRECOMPUTED_FILE = "../shared/kzg_public.kzgpre";
+
+// Attaches to the setup shared by "kzg-cli share" when KZG_SHARED_SETUP names it
+kzg::trusted_setup load_setup() {
+  const char* shared = getenv("KZG_SHARED_SETUP");
+  kzg::trusted_setup kzg = shared != NULL ? kzg::trusted_setup::attach_shared(shared, shared_digest()) : kzg::trusted_setup("../shared/kzg_public");
+  if (access(PRECOMPUTED_FILE.c_str(), F_OK) == 0) {
+    try {
+      kzg.load_precomputed(PRECOMPUTED_FILE);
+    } catch (const runtime_error& e) {
+      cerr << PRECOMPUTED_FILE << ": " << e.what() << ", not using it" << endl;
+    }
+  }
+  return kzg;
+}
+
+void precompute(int stride) {
+  kzg::trusted_setup kzg("../shared/kzg_public");
+  kzg.precompute_G1(stride);
+  kzg.save_precomputed(PRECOMPUTED_FILE);
+  cout << "fixed-base table with stride " << stride << " written to " << PRECOMPUTED_FILE << endl;
+}
+
 void create_setup(int num_coeff) {
   auto t_start = high_resolution_clock::now();
-  kzg::trusted_setup kzg(num_coeff);
+  kzg::trusted_setup::generate_setup_file("kzg_public", num_coeff);
   auto t_stop = high_resolution_clock::now();
   auto duration = duration_cast<microseconds>(t_stop - t_start);
 
   cout << "KZG trusted setup generated in " << duration.count() / 1000000.0 << "s" << endl;
   cout << "  num_coeff=" << num_coeff << endl;
   cout << "  max_commit_bytes=" << num_coeff * MAX_CHUNK_BYTES << endl;
-  
-  kzg.export_setup();
 }
 
-void commit_file(string filename) {
-  kzg::trusted_setup kzg("../shared/kzg_public");
-  
-  std::ifstream file(string(filename), std::ios::in | std::ios::binary);
-  vector<char> data(
-         (std::istreambuf_iterator<char>(file)),
-         (std::istreambuf_iterator<char>()));
-  vector<uint8_t> bytes(data.begin(), data.end());
+// Prints one commitment per file, in order
+void commit_files(const vector<string>& filenames) {
+  kzg::trusted_setup kzg = load_setup();
   
-  int chunk_size = (kzg::CURVE_ORDER_BYTES - 1);
-  int zero_pad = chunk_size - (bytes.size() % chunk_size);
+  vector<kzg::poly> polys;
+  for (auto& filename : filenames) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    vector<char> data(
+           (std::istreambuf_iterator<char>(file)),
+           (std::istreambuf_iterator<char>()));
+    vector<uint8_t> bytes(data.begin(), data.end());
+    
+    kzg::blob blob = kzg::blob::from_bytes_packed(bytes.data(), bytes.size());
+    polys.push_back(kzg::poly::from_blob(blob));
+  }
   
-  for (int i = 0; i < zero_pad; i++)
-    bytes.push_back(0);
+  for (auto& commit : kzg.create_commits(polys)) {
+    vector<uint8_t> commit_bytes = commit.serialize();
+    cout << to_hex(commit_bytes) << endl;
+  }
+}
+
+// With the commitment of the file, the polynomial is kept in filename.kzgpoly
+// and reused by later proofs instead of interpolating the file each time
+kzg::poly cached_poly(kzg::trusted_setup& kzg, string filename, string commit_string, kzg::blob& blob) {
+  string cache_filename = filename + ".kzgpoly";
+  kzg::commit commit = kzg::commit::deserialize(from_hex(commit_string));
+  try {
+    return kzg::poly::load_cache(cache_filename, commit, kzg);
+  } catch (const runtime_error& e) {
+  }
   
-  kzg::blob blob = kzg::blob::from_bytes(bytes.data(), 0, bytes.size(), chunk_size);
   kzg::poly poly = kzg::poly::from_blob(blob);
-  kzg::commit commit = kzg.create_commit(poly);
-
-  vector<uint8_t> commit_bytes = commit.serialize();
-  cout << to_hex(commit_bytes) << endl;
+  try {
+    poly.save_cache(cache_filename, commit, kzg);
+  } catch (const invalid_argument& e) {
+    cerr << "commit does not match " << filename << ", not caching" << endl;
+  }
+  return poly;
 }
 
-void create_proof(string filename, int seed) {
-  kzg::trusted_setup kzg("../shared/kzg_public");
+void create_proof(string filename, int seed, string commit_string) {
+  kzg::trusted_setup kzg = load_setup();
   
   std::ifstream file(string(filename), std::ios::in | std::ios::binary);
   vector<char> data(
@@ -70,22 +135,16 @@ void create_proof(string filename, int seed) {
          (std::istreambuf_iterator<char>()));
   vector<uint8_t> bytes(data.begin(), data.end());
   
-  int zero_pad = MAX_CHUNK_BYTES - (bytes.size() % MAX_CHUNK_BYTES);
-  
-  for (int i = 0; i < zero_pad; i++)
-    bytes.push_back(0);
-  
-  kzg::blob blob = kzg::blob::from_bytes(bytes.data(), 0, bytes.size(), MAX_CHUNK_BYTES);
-  kzg::poly poly = kzg::poly::from_blob(blob);
+  kzg::blob blob = kzg::blob::from_bytes_packed(bytes.data(), bytes.size());
+  kzg::poly poly = commit_string.empty() ? kzg::poly::from_blob(blob) : cached_poly(kzg, filename, commit_string, blob);
 
-  int chunk_length = data.size() / MAX_CHUNK_BYTES;
+  int chunk_length = blob.get_data().size();
   int random_chunk = seed % (chunk_length - 4);
 
   kzg::proof proof = kzg.create_proof(poly, random_chunk, 4);
   
-  vector<uint8_t> subsection_bytes;
-  for (int i = random_chunk * MAX_CHUNK_BYTES; i < (random_chunk + 4) * MAX_CHUNK_BYTES; i++)
-      subsection_bytes.push_back(bytes[i]);
+  size_t subsection_end = min<size_t>((random_chunk + 4) * MAX_CHUNK_BYTES, bytes.size());
+  vector<uint8_t> subsection_bytes(bytes.begin() + random_chunk * MAX_CHUNK_BYTES, bytes.begin() + subsection_end);
 
   vector<uint8_t> proof_bytes = proof.serialize();
   cout << to_hex(proof_bytes) << " " << random_chunk << " " << to_hex(subsection_bytes) << endl;
@@ -96,29 +155,291 @@ int verify_proof(string commit_string, string proof_string, int chunk_offset, st
   vector<uint8_t> proof_bytes = from_hex(proof_string);
   vector<uint8_t> data_bytes  = from_hex(data_string);
 
-  kzg::trusted_setup kzg("../shared/kzg_public");
+  kzg::trusted_setup kzg = load_setup();
   
   kzg::commit commit = kzg::commit::deserialize(commit_bytes);
   kzg::proof proof = kzg::proof::deserialize(proof_bytes);
 
-  int byte_offset = chunk_offset * MAX_CHUNK_BYTES;
-  int byte_length = 4 * MAX_CHUNK_BYTES;
-
-  kzg::blob verify = kzg::blob::from_bytes(data_bytes.data(), byte_offset, byte_length, MAX_CHUNK_BYTES);
+  kzg::blob verify = kzg::blob::from_bytes_packed(data_bytes.data(), data_bytes.size(), chunk_offset);
   return kzg.verify_proof(commit, proof, verify) ? 0 : 1;
 }
 
+void share_setup(string name) {
+  kzg::trusted_setup kzg("../shared/kzg_public");
+  vector<uint8_t> digest = kzg.publish_shared(name);
+  ofstream(SHARED_DIGEST_FILE) << to_hex(digest) << endl;
+  cout << "trusted setup shared as " << name << endl;
+  cout << "  attach to it with KZG_SHARED_SETUP=" << name << endl;
+}
+
+kzg::blob blob_from_hex(const string& s, int chunk_offset) {
+  vector<uint8_t> bytes = from_hex(s);
+  return kzg::blob::from_bytes_packed(bytes.data(), bytes.size(), chunk_offset);
+}
+
+// One request per line:
+//   commit <data>                                   -> <commit>
+//   prove <data> <chunk offset> <chunk length>      -> <proof>
+//   verify <commit> <proof> <chunk offset> <window> -> 1 or 0
+// with all byte strings in hex, data packed MAX_CHUNK_BYTES to a chunk, and
+// "error <message>" for bad requests.
+string handle_request(kzg::trusted_setup& kzg, kzg::workspace& workspace, const string& line) {
+  istringstream fields(line);
+  string command;
+  fields >> command;
+  
+  try {
+    if (command == "commit") {
+      string data;
+      fields >> data;
+      kzg::blob blob = blob_from_hex(data, 0);
+      kzg::poly poly = kzg::poly::from_blob(blob, workspace);
+      vector<uint8_t> commit_bytes = kzg.create_commit(poly).serialize();
+      return to_hex(commit_bytes);
+    } else if (command == "prove") {
+      string data;
+      int chunk_offset, chunk_length;
+      if (!(fields >> data >> chunk_offset >> chunk_length))
+        return "error bad prove request";
+      kzg::blob blob = blob_from_hex(data, 0);
+      kzg::poly poly = kzg::poly::from_blob(blob, workspace);
+      vector<uint8_t> proof_bytes = kzg.create_proof(poly, chunk_offset, chunk_length, workspace).serialize();
+      return to_hex(proof_bytes);
+    } else if (command == "verify") {
+      string commit_string, proof_string, window;
+      int chunk_offset;
+      if (!(fields >> commit_string >> proof_string >> chunk_offset >> window))
+        return "error bad verify request";
+      kzg::commit commit = kzg::commit::deserialize(from_hex(commit_string));
+      kzg::proof proof = kzg::proof::deserialize(from_hex(proof_string));
+      kzg::blob expected = blob_from_hex(window, chunk_offset);
+      return kzg.verify_proof(commit, proof, expected, workspace) ? "1" : "0";
+    }
+  } catch (const exception& e) {
+    return string("error ") + e.what();
+  }
+  
+  return "error unknown command";
+}
+
+bool write_all(int fd, const string& s) {
+  size_t done = 0;
+  while (done < s.size()) {
+    ssize_t n = write(fd, s.data() + done, s.size() - done);
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+// Serves requests on a loopback port, one thread per connection
+void serve(int port) {
+  kzg::trusted_setup kzg = load_setup();
+  ZZ_pContext context;
+  context.save();
+  
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+    cerr << "could not listen on port " << port << endl;
+    exit(1);
+  }
+  cout << "serving on 127.0.0.1:" << port << endl;
+  
+  while (true) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      continue;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+    thread([&kzg, &context, fd]() {
+      context.restore();
+      kzg::workspace workspace;
+      string buffer;
+      char chunk[65536];
+      while (true) {
+        size_t end = buffer.find('\n');
+        if (end == string::npos) {
+          ssize_t n = read(fd, chunk, sizeof(chunk));
+          if (n <= 0)
+            break;
+          buffer.append(chunk, n);
+          continue;
+        }
+        
+        string response = handle_request(kzg, workspace, buffer.substr(0, end)) + "\n";
+        buffer.erase(0, end + 1);
+        if (!write_all(fd, response))
+          break;
+      }
+      close(fd);
+    }).detach();
+  }
+}
+
+// Records for verify-batch, with big endian 32-bit lengths and offset:
+//   commit length, commit, proof length, proof, chunk offset, data length, data
+void write_u32(string& out, uint32_t value) {
+  for (int i = 3; i >= 0; i--)
+    out.push_back((char) (value >> (8 * i)));
+}
+
+bool read_u32(istream& in, uint32_t& value) {
+  uint8_t bytes[4];
+  if (!in.read((char*) bytes, 4))
+    return false;
+  value = ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+  return true;
+}
+
+bool read_field(istream& in, vector<uint8_t>& field) {
+  uint32_t length;
+  if (!read_u32(in, length))
+    return false;
+  field.resize(length);
+  return length == 0 || (bool) in.read((char*) field.data(), length);
+}
+
+void pack_record(string commit_string, string proof_string, int chunk_offset, string data_string) {
+  string out;
+  for (const string* field : { &commit_string, &proof_string }) {
+    vector<uint8_t> bytes = from_hex(*field);
+    write_u32(out, bytes.size());
+    out.append(bytes.begin(), bytes.end());
+  }
+  write_u32(out, chunk_offset);
+  vector<uint8_t> data = from_hex(data_string);
+  write_u32(out, data.size());
+  out.append(data.begin(), data.end());
+  cout.write(out.data(), out.size());
+}
+
+struct record {
+  vector<uint8_t> commit, proof, data;
+  uint32_t chunk_offset;
+};
+
+// Verifies records from a file or stdin and prints pass or fail for each,
+// records that cannot be decoded fail
+int verify_batch(string filename) {
+  ifstream file;
+  if (!filename.empty() && filename != "-") {
+    file.open(filename, ios::in | ios::binary);
+    if (!file.is_open()) {
+      cerr << "could not open " << filename << endl;
+      return 2;
+    }
+  }
+  istream& in = file.is_open() ? file : cin;
+
+  vector<record> records;
+  while (in.peek() != EOF) {
+    record r;
+    if (!read_field(in, r.commit) || !read_field(in, r.proof) || !read_u32(in, r.chunk_offset) || !read_field(in, r.data)) {
+      cerr << "truncated record " << records.size() << endl;
+      return 2;
+    }
+    records.push_back(r);
+  }
+
+  kzg::trusted_setup kzg = load_setup();
+  ZZ_pContext context;
+  context.save();
+
+  // decoding points takes square roots, so records are decoded in parallel
+  size_t n = records.size();
+  vector<unique_ptr<kzg::commit>> commits(n);
+  vector<unique_ptr<kzg::proof>> proofs(n);
+  vector<unique_ptr<kzg::blob>> blobs(n);
+  vector<thread> threads;
+  size_t num_threads = min<size_t>(kzg::PROFILE.thread_count(), max<size_t>(n, 1));
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.push_back(thread([&, t]() {
+      context.restore();
+      for (size_t i = n * t / num_threads; i < n * (t + 1) / num_threads; i++) {
+        record& r = records[i];
+        try {
+          if (r.data.empty())
+            continue;
+          commits[i].reset(new kzg::commit(kzg::commit::deserialize(r.commit)));
+          proofs[i].reset(new kzg::proof(kzg::proof::deserialize(r.proof)));
+          blobs[i].reset(new kzg::blob(kzg::blob::from_bytes_packed(r.data.data(), r.data.size(), r.chunk_offset)));
+        } catch (const exception& e) {
+          commits[i].reset();
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  vector<kzg::commit> batch_commits;
+  vector<kzg::proof> batch_proofs;
+  vector<kzg::blob> batch_blobs;
+  vector<size_t> indices;
+  for (size_t i = 0; i < n; i++) {
+    if (commits[i] && proofs[i] && blobs[i]) {
+      batch_commits.push_back(*commits[i]);
+      batch_proofs.push_back(*proofs[i]);
+      batch_blobs.push_back(*blobs[i]);
+      indices.push_back(i);
+    }
+  }
+
+  vector<bool> passed(n, false);
+  vector<bool> results = kzg.verify_proofs(batch_commits, batch_proofs, batch_blobs);
+  for (size_t j = 0; j < indices.size(); j++)
+    passed[indices[j]] = results[j];
+
+  bool all_passed = true;
+  string out;
+  for (size_t i = 0; i < n; i++) {
+    out += passed[i] ? "pass\n" : "fail\n";
+    all_passed = all_passed && passed[i];
+  }
+  cout << out;
+  return all_passed ? 0 : 1;
+}
+
+void calibrate(string filename) {
+  kzg::profile profile = kzg::profile::calibrate(true);
+  profile.save(filename);
+  cout << "calibration profile written to " << filename << endl;
+  cout << "  load it with KZG_PROFILE=" << filename << endl;
+}
+
 int main(int argc, char *argv[]) {
   kzg::init();
   
   if (string(argv[1]) == "setup") {
     create_setup(stoi(argv[2]));
   } else if (string(argv[1]) == "commit") {
-    commit_file(string(argv[2]));
+    commit_files(vector<string>(argv + 2, argv + argc));
   } else if (string(argv[1]) == "prove") {
-    create_proof(string(argv[2]), stoi(argv[3]));
+    create_proof(string(argv[2]), stoi(argv[3]), argc > 4 ? string(argv[4]) : "");
   } else if (string(argv[1]) == "verify") {
     return verify_proof(string(argv[2]), string(argv[3]), stoi(argv[4]), string(argv[5]));
+  } else if (string(argv[1]) == "pack") {
+    pack_record(string(argv[2]), string(argv[3]), stoi(argv[4]), string(argv[5]));
+  } else if (string(argv[1]) == "verify-batch") {
+    return verify_batch(argc > 2 ? string(argv[2]) : "-");
+  } else if (string(argv[1]) == "precompute") {
+    precompute(argc > 2 ? stoi(argv[2]) : 64);
+  } else if (string(argv[1]) == "share") {
+    share_setup(argc > 2 ? string(argv[2]) : "kzg_public");
+  } else if (string(argv[1]) == "unshare") {
+    kzg::trusted_setup::unlink_shared(argc > 2 ? string(argv[2]) : "kzg_public");
+  } else if (string(argv[1]) == "serve") {
+    serve(argc > 2 ? stoi(argv[2]) : 7878);
+  } else if (string(argv[1]) == "calibrate") {
+    calibrate(argc > 2 ? string(argv[2]) : "kzg_profile");
   }
   
   return 0;
@@ -1,4 +1,8 @@
 #include <kzg.h>
+#include "util.h"
+#include "field.h"
+
+#include <climits>
 
 kzg::blob kzg::blob::from_string(string s) {
   return kzg::blob::from_string(s, 0);
@@ -17,6 +21,26 @@ kzg::blob kzg::blob::from_string(string s, int offset) {
   return kzg::blob(data); 
 }
 
+// Encodes chunk_size little-endian bytes as a field element
+static ZZ_p chunk_to_ZZ_p(const uint8_t* chunk, int chunk_size) {
+  ZZ chunk_scalar;
+#ifdef KZG_NTL_SCALARS
+  unsigned char chunk_data[MODBYTES_CURVE] = {0};
+  for (int j = 0; j < chunk_size; j++)
+    chunk_data[j] = chunk[j];
+  
+  ZZFromBytes(chunk_scalar, chunk_data, MODBYTES_CURVE);
+#else
+  uint64_t limbs[FR_LIMBS] = {0};
+  for (int j = 0; j < chunk_size; j++)
+    limbs[j / 8] |= (uint64_t) chunk[j] << (8 * (j % 8));
+  
+  ZZ_from_limbs(chunk_scalar, limbs);
+#endif
+  
+  return conv<ZZ_p>(chunk_scalar);
+}
+
 kzg::blob kzg::blob::from_bytes(const uint8_t* bytes, int byte_offset, int byte_length, int chunk_size) {
   if (chunk_size > MAX_CHUNK_BYTES)
     throw invalid_argument("chunk_size must be at most MAX_CHUNK_BYTES.");
@@ -30,19 +54,78 @@ kzg::blob kzg::blob::from_bytes(const uint8_t* bytes, int byte_offset, int byte_
 
   vector<pair<ZZ_p, ZZ_p>> data;
   for (int i = 0; i < chunk_length; i++) {
-    unsigned char chunk_data[MODBYTES_CURVE] = {0};
-    for (int j = 0; j < chunk_size; j++)
-      chunk_data[j] = bytes[i * chunk_size + j];
+    ZZ_p ZZ_x, ZZ_y;
+    ZZ_x = chunk_offset + i;
+    ZZ_y = chunk_to_ZZ_p(bytes + i * chunk_size, chunk_size);
     
-    ZZ chunk_scalar;
-    ZZFromBytes(chunk_scalar, chunk_data, MODBYTES_CURVE);
+    data.push_back({ZZ_x, ZZ_y});
+  }
+  
+  return kzg::blob(data);
+}
+
+kzg::blob kzg::blob::from_bytes(const uint8_t* bytes, const std::vector<int>& chunk_indices, int chunk_size) {
+  if (chunk_size > MAX_CHUNK_BYTES)
+    throw invalid_argument("chunk_size must be at most MAX_CHUNK_BYTES.");
+  
+  vector<pair<ZZ_p, ZZ_p>> data;
+  for (size_t i = 0; i < chunk_indices.size(); i++) {
+    if (chunk_indices[i] < 0)
+      throw invalid_argument("chunk indices must be non-negative.");
     
     ZZ_p ZZ_x, ZZ_y;
-    ZZ_x = chunk_offset + i;
-    ZZ_y = conv<ZZ_p>(chunk_scalar);
+    ZZ_x = chunk_indices[i];
+    ZZ_y = chunk_to_ZZ_p(bytes + i * chunk_size, chunk_size);
     
     data.push_back({ZZ_x, ZZ_y});
   }
   
   return kzg::blob(data);
 }
+
+kzg::blob kzg::blob::from_bytes_packed(const uint8_t* bytes, size_t length, int chunk_offset, int chunk_size) {
+  if (chunk_size < 1 || chunk_size > MAX_CHUNK_BYTES)
+    throw invalid_argument("chunk_size must be between 1 and MAX_CHUNK_BYTES.");
+  else if (chunk_offset < 0)
+    throw invalid_argument("chunk_offset must be non-negative.");
+  
+  size_t num_chunks = (length + chunk_size - 1) / chunk_size;
+  vector<pair<ZZ_p, ZZ_p>> data(num_chunks);
+  for (size_t i = 0; i < num_chunks; i++) {
+    size_t begin = i * chunk_size;
+    data[i].first = chunk_offset + (long) i;
+    data[i].second = chunk_to_ZZ_p(bytes + begin, min<size_t>(chunk_size, length - begin));
+  }
+  
+  return kzg::blob(data);
+}
+
+kzg::blob kzg::blob::from_string_packed(const string& s, int chunk_offset) {
+  return from_bytes_packed(reinterpret_cast<const uint8_t*>(s.data()), s.size(), chunk_offset);
+}
+
+std::pair<int, int> kzg::blob::chunk_window(uint64_t byte_offset, uint64_t byte_length, int chunk_size) {
+  if (chunk_size < 1)
+    throw invalid_argument("chunk_size must be positive.");
+  else if (byte_length == 0)
+    throw invalid_argument("byte_length must be positive.");
+  
+  else if (byte_length - 1 > UINT64_MAX - byte_offset)
+    throw invalid_argument("byte range overflows.");
+  
+  // chunk indices are ints everywhere else, a window past INT_MAX cannot be proven
+  uint64_t first = byte_offset / chunk_size;
+  uint64_t last = (byte_offset + byte_length - 1) / chunk_size;
+  if (last >= (uint64_t) INT_MAX)
+    throw invalid_argument("byte range is beyond INT_MAX chunks.");
+  return { (int) first, (int) (last - first + 1) };
+}
+
+ZZ_p kzg::blob::evaluate(const ZZ_p& z) {
+  if (data.size() < 1)
+    throw invalid_argument("blob must not be empty");
+  
+  ZZ_p y;
+  barycentric_eval(y, data, z);
+  return y;
+}
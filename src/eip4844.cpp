@@ -0,0 +1,676 @@
+#include <kzg.h>
+
+#ifdef KZG_CURVE_BLS12381
+
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "util.h"
+#include "field.h"
+#include "msm.h"
+
+static_assert(MODBYTES_CURVE == 48, "EIP-4844 points are encoded over 48-byte coordinates");
+
+static const int N = kzg::eip4844::FIELD_ELEMENTS_PER_BLOB;
+static const int LOG2_N = 12;
+static const int PRIMITIVE_ROOT_OF_UNITY = 7;
+static const int SETUP_G2_POINTS = 65;
+
+static const char CHALLENGE_DOMAIN[] = "FSBLOBVERIFY_V1_";
+static const char BATCH_DOMAIN[] = "RCKZGBATCH___V1_";
+
+// ZCash point encoding: big-endian x with three flag bits in its first byte
+static const uint8_t FLAG_COMPRESSED = 0x80;
+static const uint8_t FLAG_INFINITY = 0x40;
+static const uint8_t FLAG_SIGN = 0x20;
+
+// Roots of unity of order N in bit-reversed order, the evaluation domain of blobs
+struct kzg::eip4844::domain {
+  fr_vec roots;
+  fr inv_n;
+};
+
+static int bit_reverse(int i) {
+  int res = 0;
+  for (int b = 0; b < LOG2_N; b++)
+    res |= ((i >> b) & 1) << (LOG2_N - 1 - b);
+  return res;
+}
+
+static std::shared_ptr<const kzg::eip4844::domain> make_domain() {
+  auto d = std::make_shared<kzg::eip4844::domain>();
+
+  // 7^((r - 1) / N) generates the subgroup of order N
+  uint64_t exponent[FR_LIMBS];
+  for (int i = 0; i < FR_LIMBS; i++)
+    exponent[i] = FR.modulus[i];
+  exponent[0] -= 1;
+  for (int i = 0; i < FR_LIMBS; i++)
+    exponent[i] = (exponent[i] >> LOG2_N) | (i + 1 < FR_LIMBS ? exponent[i + 1] << (64 - LOG2_N) : 0);
+
+  fr generator, root;
+  fr_from_u64(generator, PRIMITIVE_ROOT_OF_UNITY);
+  fr_pow(root, generator, exponent, FR_LIMBS);
+
+  d->roots.resize(N);
+  fr w = FR.one;
+  for (int i = 0; i < N; i++) {
+    d->roots[bit_reverse(i)] = w;
+    fr_mul(w, w, root);
+  }
+
+  fr n;
+  fr_from_u64(n, N);
+  fr_inv(d->inv_n, n);
+  return d;
+}
+
+// Field elements are 32 big-endian bytes, non-canonical values are rejected
+static void fr_from_bytes32(fr& r, const uint8_t* bytes) {
+  uint64_t limbs[FR_LIMBS] = {0};
+  for (int i = 0; i < 32; i++)
+    limbs[(31 - i) / 8] |= (uint64_t) bytes[i] << (8 * ((31 - i) % 8));
+
+  if (fr_geq_modulus(limbs))
+    throw invalid_argument("field element is not below the curve order");
+  fr_from_limbs(r, limbs);
+}
+
+static void fr_to_bytes32(uint8_t* bytes, const fr& a) {
+  uint64_t limbs[FR_LIMBS];
+  fr_to_limbs(limbs, a);
+  for (int i = 0; i < 32; i++)
+    bytes[i] = (uint8_t) (limbs[(31 - i) / 8] >> (8 * ((31 - i) % 8)));
+}
+
+static void fr_from_bytes32(fr& r, const std::vector<uint8_t>& bytes) {
+  if (bytes.size() != kzg::eip4844::BYTES_PER_FIELD_ELEMENT)
+    throw invalid_argument("field elements are 32 bytes");
+  fr_from_bytes32(r, bytes.data());
+}
+
+// hash_to_bls_field: the digest as a big-endian integer, reduced modulo r
+static void fr_from_digest(fr& r, const uint8_t* digest) {
+  uint64_t limbs[FR_LIMBS] = {0};
+  for (int i = 0; i < 32; i++)
+    limbs[(31 - i) / 8] |= (uint64_t) digest[i] << (8 * ((31 - i) % 8));
+
+  while (fr_geq_modulus(limbs))
+    fr_sub_modulus(limbs);
+  fr_from_limbs(r, limbs);
+}
+
+static void hash_bytes(hash256& sh, const uint8_t* bytes, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    HASH256_process(&sh, bytes[i]);
+}
+
+static void hash_uint_be(hash256& sh, uint64_t value, int width) {
+  for (int i = width - 1; i >= 0; i--)
+    HASH256_process(&sh, i < 8 ? (int) ((value >> (8 * i)) & 0xff) : 0);
+}
+
+// y > (p - 1) / 2, the sign of the ZCash encoding
+static bool fp_is_larger(BIG y) {
+  BIG half;
+  BIG_rcopy(half, Modulus);
+  BIG_dec(half, 1);
+  BIG_norm(half);
+  BIG_shr(half, 1);
+  return BIG_comp(y, half) > 0;
+}
+
+// Fp2 elements compare on their imaginary part first
+static bool fp2_is_larger(FP2& y) {
+  BIG c0, c1;
+  FP_redc(c0, &y.a);
+  FP_redc(c1, &y.b);
+  return BIG_iszilch(c1) ? fp_is_larger(c0) : fp_is_larger(c1);
+}
+
+// Splits off the flags, checks that the encoding is compressed and returns
+// false for a well-formed encoding of infinity
+static bool read_flags(uint8_t& flags, char* x_bytes, const uint8_t* bytes, size_t size, bool& valid) {
+  flags = bytes[0] & 0xe0;
+  memcpy(x_bytes, bytes, size);
+  x_bytes[0] &= 0x1f;
+
+  valid = (flags & FLAG_COMPRESSED) != 0;
+  if (!(flags & FLAG_INFINITY))
+    return true;
+
+  valid = valid && !(flags & FLAG_SIGN);
+  for (size_t i = 0; i < size; i++)
+    valid = valid && x_bytes[i] == 0;
+  return false;
+}
+
+static bool G1_from_bytes(ECP& P, const uint8_t* bytes) {
+  uint8_t flags;
+  char x_bytes[48];
+  bool valid;
+  if (!read_flags(flags, x_bytes, bytes, sizeof(x_bytes), valid)) {
+    ECP_inf(&P);
+    return valid;
+  }
+  if (!valid)
+    return false;
+
+  BIG x, y, p;
+  BIG_fromBytes(x, x_bytes);
+  BIG_rcopy(p, Modulus);
+  if (BIG_comp(x, p) >= 0 || !ECP_setx(&P, x, 0))
+    return false;
+
+  ECP_get(x, y, &P);
+  if (fp_is_larger(y) != ((flags & FLAG_SIGN) != 0))
+    ECP_neg(&P);
+  return true;
+}
+
+static bool G2_from_bytes(ECP2& P, const uint8_t* bytes) {
+  uint8_t flags;
+  char x_bytes[96];
+  bool valid;
+  if (!read_flags(flags, x_bytes, bytes, sizeof(x_bytes), valid)) {
+    ECP2_inf(&P);
+    return valid;
+  }
+  if (!valid)
+    return false;
+
+  // the imaginary part comes first
+  BIG x0, x1, p;
+  BIG_fromBytes(x1, x_bytes);
+  BIG_fromBytes(x0, x_bytes + 48);
+  BIG_rcopy(p, Modulus);
+  if (BIG_comp(x0, p) >= 0 || BIG_comp(x1, p) >= 0)
+    return false;
+
+  FP2 x, y;
+  FP2_from_BIGs(&x, x0, x1);
+  if (!ECP2_setx(&P, &x, 0))
+    return false;
+
+  ECP2_get(&x, &y, &P);
+  if (fp2_is_larger(y) != ((flags & FLAG_SIGN) != 0))
+    ECP2_neg(&P);
+  return true;
+}
+
+static void G1_to_bytes(uint8_t* bytes, ECP& P) {
+  memset(bytes, 0, 48);
+  if (ECP_isinf(&P)) {
+    bytes[0] = FLAG_COMPRESSED | FLAG_INFINITY;
+    return;
+  }
+
+  BIG x, y;
+  ECP_get(x, y, &P);
+  BIG_toBytes(reinterpret_cast<char*>(bytes), x);
+  bytes[0] |= FLAG_COMPRESSED;
+  if (fp_is_larger(y))
+    bytes[0] |= FLAG_SIGN;
+}
+
+static void G2_to_bytes(uint8_t* bytes, ECP2& P) {
+  memset(bytes, 0, 96);
+  if (ECP2_isinf(&P)) {
+    bytes[0] = FLAG_COMPRESSED | FLAG_INFINITY;
+    return;
+  }
+
+  FP2 x, y;
+  ECP2_get(&x, &y, &P);
+  BIG x0, x1;
+  FP_redc(x0, &x.a);
+  FP_redc(x1, &x.b);
+  BIG_toBytes(reinterpret_cast<char*>(bytes), x1);
+  BIG_toBytes(reinterpret_cast<char*>(bytes) + 48, x0);
+  bytes[0] |= FLAG_COMPRESSED;
+  if (fp2_is_larger(y))
+    bytes[0] |= FLAG_SIGN;
+}
+
+// Commitments and proofs received from others must be points of the subgroup
+static void parse_G1(ECP& P, const std::vector<uint8_t>& bytes) {
+  if (bytes.size() != 48 || !G1_from_bytes(P, bytes.data()) || !(ECP_isinf(&P) || PAIR_G1member(&P)))
+    throw invalid_argument("not a compressed G1 point of the subgroup");
+}
+
+static bool hex_to_bytes(uint8_t* bytes, const std::string& hex, size_t size) {
+  size_t start = hex.compare(0, 2, "0x") == 0 ? 2 : 0;
+  if (hex.size() - start != 2 * size)
+    return false;
+
+  for (size_t i = 0; i < size; i++) {
+    int value = 0;
+    for (int j = 0; j < 2; j++) {
+      char c = hex[start + 2 * i + j];
+      int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+      if (digit < 0)
+        return false;
+      value = 16 * value + digit;
+    }
+    bytes[i] = (uint8_t) value;
+  }
+  return true;
+}
+
+static std::string bytes_to_hex(const uint8_t* bytes, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < size; i++) {
+    hex.push_back(digits[bytes[i] >> 4]);
+    hex.push_back(digits[bytes[i] & 0xf]);
+  }
+  return hex;
+}
+
+kzg::eip4844::eip4844(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open())
+    throw runtime_error("could not open trusted setup file");
+
+  int num_G1, num_G2;
+  if (!(file >> num_G1 >> num_G2) || num_G1 != N || num_G2 < 2)
+    throw runtime_error("bad trusted setup file");
+
+  std::vector<std::string> lines(num_G1 + num_G2);
+  for (std::string& line : lines) {
+    if (!(file >> line))
+      throw runtime_error("bad trusted setup file");
+  }
+
+  // The points of the published setup are trusted, decompression already
+  // rejects anything off the curve and the subgroup checks are skipped to
+  // keep loading fast. Lagrange points are stored in bit-reversed order to
+  // line up with the domain.
+  std::vector<ECP> G1_points(num_G1);
+  _G2_monomial.resize(num_G2);
+  std::atomic<bool> valid(true);
+  parallel_ranges(num_G1 + num_G2, [&](uint64_t begin, uint64_t end) {
+    uint8_t bytes[96];
+    for (uint64_t i = begin; i < end; i++) {
+      if (i < (uint64_t) num_G1) {
+        if (!hex_to_bytes(bytes, lines[i], 48) || !G1_from_bytes(G1_points[bit_reverse(i)], bytes))
+          valid = false;
+      } else {
+        if (!hex_to_bytes(bytes, lines[i], 96) || !G2_from_bytes(_G2_monomial[i - num_G1], bytes))
+          valid = false;
+      }
+    }
+  });
+  if (!valid)
+    throw runtime_error("bad trusted setup file");
+
+  _G1_lagrange.allocate(num_G1);
+  parallel_ranges(num_G1, [&](uint64_t begin, uint64_t end) {
+    normalize_G1(&_G1_lagrange[begin], &G1_points[begin], end - begin);
+  });
+
+  _domain = make_domain();
+}
+
+void kzg::eip4844::generate_setup_file(const std::string& filename) {
+  std::shared_ptr<const domain> d = make_domain();
+
+  fr s, s_n;
+  do {
+    BIG BIG_s;
+    generate_random_BIG(BIG_s);
+    fr_from_BIG(s, BIG_s);
+    s_n = s;
+    for (int i = 0; i < LOG2_N; i++)
+      fr_mul(s_n, s_n, s_n);
+  } while (fr_equals(s_n, FR.one));
+
+  // L_i(s) = w_i (s^N - 1) / (N (s - w_i)), the file lists them in natural order
+  fr_vec lagrange(N);
+  for (int i = 0; i < N; i++)
+    fr_sub(lagrange[i], s, d->roots[bit_reverse(i)]);
+  fr_batch_inv(lagrange, lagrange);
+
+  fr scale;
+  fr_sub(scale, s_n, FR.one);
+  fr_mul(scale, scale, d->inv_n);
+  for (int i = 0; i < N; i++) {
+    fr_mul(lagrange[i], lagrange[i], d->roots[bit_reverse(i)]);
+    fr_mul(lagrange[i], lagrange[i], scale);
+  }
+
+  fr_vec powers(SETUP_G2_POINTS);
+  powers[0] = FR.one;
+  for (int i = 1; i < SETUP_G2_POINTS; i++)
+    fr_mul(powers[i], powers[i - 1], s);
+
+  std::vector<std::string> lines(N + SETUP_G2_POINTS);
+  parallel_ranges(lines.size(), [&](uint64_t begin, uint64_t end) {
+    uint8_t bytes[96];
+    BIG scalar;
+    for (uint64_t i = begin; i < end; i++) {
+      if (i < (uint64_t) N) {
+        ECP P;
+        ECP_generator(&P);
+        fr_to_BIG(scalar, lagrange[i]);
+        PAIR_G1mul(&P, scalar);
+        G1_to_bytes(bytes, P);
+        lines[i] = bytes_to_hex(bytes, 48);
+      } else {
+        ECP2 Q;
+        ECP2_generator(&Q);
+        fr_to_BIG(scalar, powers[i - N]);
+        PAIR_G2mul(&Q, scalar);
+        G2_to_bytes(bytes, Q);
+        lines[i] = bytes_to_hex(bytes, 96);
+      }
+    }
+  });
+
+  std::ofstream file(filename, std::ios::out | std::ios::trunc);
+  if (!file.is_open())
+    throw runtime_error("could not write trusted setup file");
+
+  file << N << endl << SETUP_G2_POINTS << endl;
+  for (const std::string& line : lines)
+    file << line << endl;
+}
+
+static void blob_to_polynomial(fr_vec& poly, const std::vector<uint8_t>& blob) {
+  if (blob.size() != kzg::eip4844::BYTES_PER_BLOB)
+    throw invalid_argument("blobs are BYTES_PER_BLOB bytes");
+
+  poly.resize(N);
+  for (int i = 0; i < N; i++)
+    fr_from_bytes32(poly[i], &blob[i * kzg::eip4844::BYTES_PER_FIELD_ELEMENT]);
+}
+
+template <typename P>
+static void lincomb(ECP& res, const P* points, const fr* scalars, int n) {
+  std::vector<BIG> BIG_scalars(n);
+  for (int i = 0; i < n; i++)
+    fr_to_BIG(BIG_scalars[i], scalars[i]);
+  msm_G1(res, points, BIG_scalars.data(), n);
+}
+
+// Evaluates the polynomial given by its values on the domain at z. index is
+// set to the position of z in the domain or -1, and inv to 1 / (z - w_i),
+// with 0 at index, for the quotient.
+static void evaluate(fr& y, int& index, fr_vec& inv, const fr_vec& poly, const kzg::eip4844::domain& d, const fr& z) {
+  index = -1;
+  inv.resize(N);
+  for (int i = 0; i < N; i++) {
+    fr_sub(inv[i], z, d.roots[i]);
+    if (fr_is_zero(inv[i])) {
+      index = i;
+      inv[i] = FR.one;
+    }
+  }
+  fr_batch_inv(inv, inv);
+
+  if (index >= 0) {
+    fr_zero(inv[index]);
+    y = poly[index];
+    return;
+  }
+
+  // barycentric formula, (z^N - 1) / N * sum p_i w_i / (z - w_i)
+  fr sum, term;
+  fr_zero(sum);
+  for (int i = 0; i < N; i++) {
+    fr_mul(term, poly[i], d.roots[i]);
+    fr_mul(term, term, inv[i]);
+    fr_add(sum, sum, term);
+  }
+
+  fr z_n = z;
+  for (int i = 0; i < LOG2_N; i++)
+    fr_mul(z_n, z_n, z_n);
+  fr_sub(z_n, z_n, FR.one);
+  fr_mul(y, sum, z_n);
+  fr_mul(y, y, d.inv_n);
+}
+
+// Values of (p(X) - y) / (X - z) on the domain
+static void quotient(fr_vec& q, const fr_vec& poly, const fr& y, int index, const fr_vec& inv, const kzg::eip4844::domain& d, const fr& z) {
+  q.resize(N);
+  fr diff;
+  for (int i = 0; i < N; i++) {
+    fr_sub(diff, y, poly[i]);
+    fr_mul(q[i], diff, inv[i]);
+  }
+
+  // at z itself, sum (p_i - y) w_i / (z (z - w_i)) = -sum q_i w_i / z
+  if (index >= 0) {
+    fr sum, term, z_inv;
+    fr_zero(sum);
+    for (int i = 0; i < N; i++) {
+      fr_mul(term, q[i], d.roots[i]);
+      fr_add(sum, sum, term);
+    }
+    fr_inv(z_inv, z);
+    fr_mul(sum, sum, z_inv);
+    fr_neg(q[index], sum);
+  }
+}
+
+static void blob_challenge(fr& r, const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment) {
+  hash256 sh;
+  HASH256_init(&sh);
+  hash_bytes(sh, reinterpret_cast<const uint8_t*>(CHALLENGE_DOMAIN), sizeof(CHALLENGE_DOMAIN) - 1);
+  hash_uint_be(sh, N, 16);
+  hash_bytes(sh, blob.data(), blob.size());
+  hash_bytes(sh, commitment.data(), commitment.size());
+
+  char digest[32];
+  HASH256_hash(&sh, digest);
+  fr_from_digest(r, reinterpret_cast<uint8_t*>(digest));
+}
+
+// e(proof, [s - z]2) = e(commitment - [y]1, [1]2)
+static bool verify_kzg_proof(ECP2& s_G2, ECP& commitment, const fr& z, const fr& y, ECP& proof) {
+  BIG BIG_z, BIG_y;
+  fr_to_BIG(BIG_z, z);
+  fr_to_BIG(BIG_y, y);
+
+  ECP2 s_minus_z, G2;
+  ECP2_generator(&G2);
+  ECP2_copy(&s_minus_z, &G2);
+  mul_vartime_G2(s_minus_z, BIG_z);
+  ECP2_neg(&s_minus_z);
+  ECP2_add(&s_minus_z, &s_G2);
+
+  ECP rhs;
+  ECP_generator(&rhs);
+  mul_vartime_G1(rhs, BIG_y);
+  ECP_neg(&rhs);
+  ECP_add(&rhs, &commitment);
+  ECP_neg(&rhs);
+
+  FP12 v;
+  PAIR_double_ate(&v, &s_minus_z, &proof, &G2, &rhs);
+  PAIR_fexp(&v);
+  return FP12_isunity(&v);
+}
+
+static std::vector<uint8_t> proof_at(const kzg::point_table<kzg::G1_affine>& G1_lagrange, const fr_vec& poly, const kzg::eip4844::domain& d, const fr& z, fr& y) {
+  int index;
+  fr_vec inv, q;
+  evaluate(y, index, inv, poly, d, z);
+  quotient(q, poly, y, index, inv, d, z);
+
+  ECP proof;
+  lincomb(proof, G1_lagrange.data(), q.data(), N);
+  std::vector<uint8_t> bytes(kzg::eip4844::BYTES_PER_PROOF);
+  G1_to_bytes(bytes.data(), proof);
+  return bytes;
+}
+
+std::vector<uint8_t> kzg::eip4844::blob_to_commitment(const std::vector<uint8_t>& blob) {
+  fr_vec poly;
+  blob_to_polynomial(poly, blob);
+
+  ECP commitment;
+  lincomb(commitment, _G1_lagrange.data(), poly.data(), N);
+  std::vector<uint8_t> bytes(BYTES_PER_COMMITMENT);
+  G1_to_bytes(bytes.data(), commitment);
+  return bytes;
+}
+
+std::pair<std::vector<uint8_t>, std::vector<uint8_t>> kzg::eip4844::compute_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& z) {
+  fr_vec poly;
+  blob_to_polynomial(poly, blob);
+  fr fr_z, y;
+  fr_from_bytes32(fr_z, z);
+
+  std::vector<uint8_t> proof = proof_at(_G1_lagrange, poly, *_domain, fr_z, y);
+  std::vector<uint8_t> y_bytes(BYTES_PER_FIELD_ELEMENT);
+  fr_to_bytes32(y_bytes.data(), y);
+  return { proof, y_bytes };
+}
+
+std::vector<uint8_t> kzg::eip4844::compute_blob_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment) {
+  fr_vec poly;
+  blob_to_polynomial(poly, blob);
+  ECP C;
+  parse_G1(C, commitment);
+
+  fr z, y;
+  blob_challenge(z, blob, commitment);
+  return proof_at(_G1_lagrange, poly, *_domain, z, y);
+}
+
+std::vector<uint8_t> kzg::eip4844::compute_challenge(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment) {
+  if (blob.size() != BYTES_PER_BLOB)
+    throw invalid_argument("blobs are BYTES_PER_BLOB bytes");
+  else if (commitment.size() != BYTES_PER_COMMITMENT)
+    throw invalid_argument("commitments are BYTES_PER_COMMITMENT bytes");
+
+  fr z;
+  blob_challenge(z, blob, commitment);
+  std::vector<uint8_t> bytes(BYTES_PER_FIELD_ELEMENT);
+  fr_to_bytes32(bytes.data(), z);
+  return bytes;
+}
+
+bool kzg::eip4844::verify_proof(const std::vector<uint8_t>& commitment, const std::vector<uint8_t>& z, const std::vector<uint8_t>& y, const std::vector<uint8_t>& proof) {
+  ECP C, pi;
+  parse_G1(C, commitment);
+  parse_G1(pi, proof);
+  fr fr_z, fr_y;
+  fr_from_bytes32(fr_z, z);
+  fr_from_bytes32(fr_y, y);
+
+  return verify_kzg_proof(_G2_monomial[1], C, fr_z, fr_y, pi);
+}
+
+bool kzg::eip4844::verify_blob_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment, const std::vector<uint8_t>& proof) {
+  fr_vec poly, inv;
+  blob_to_polynomial(poly, blob);
+  ECP C, pi;
+  parse_G1(C, commitment);
+  parse_G1(pi, proof);
+
+  fr z, y;
+  int index;
+  blob_challenge(z, blob, commitment);
+  evaluate(y, index, inv, poly, *_domain, z);
+  return verify_kzg_proof(_G2_monomial[1], C, z, y, pi);
+}
+
+bool kzg::eip4844::verify_blob_proof_batch(const std::vector<std::vector<uint8_t>>& blobs, const std::vector<std::vector<uint8_t>>& commitments, const std::vector<std::vector<uint8_t>>& proofs) {
+  if (blobs.size() != commitments.size() || blobs.size() != proofs.size())
+    throw invalid_argument("blobs, commitments and proofs must be of the same size");
+
+  int n = blobs.size();
+  if (n == 0)
+    return true;
+
+  // points and the challenge and value of each blob, blobs are independent
+  // so they are evaluated in parallel
+  std::vector<ECP> points(2 * n);
+  fr_vec zs(n), ys(n);
+  for (int i = 0; i < n; i++) {
+    parse_G1(points[i], commitments[i]);
+    parse_G1(points[n + i], proofs[i]);
+  }
+
+  std::vector<std::exception_ptr> errors(n);
+  parallel_ranges(n, [&](uint64_t begin, uint64_t end) {
+    fr_vec poly, inv;
+    int index;
+    for (uint64_t i = begin; i < end; i++) {
+      try {
+        blob_to_polynomial(poly, blobs[i]);
+        blob_challenge(zs[i], blobs[i], commitments[i]);
+        evaluate(ys[i], index, inv, poly, *_domain, zs[i]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  });
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  if (n == 1)
+    return verify_kzg_proof(_G2_monomial[1], points[0], zs[0], ys[0], points[1]);
+
+  hash256 sh;
+  HASH256_init(&sh);
+  hash_bytes(sh, reinterpret_cast<const uint8_t*>(BATCH_DOMAIN), sizeof(BATCH_DOMAIN) - 1);
+  hash_uint_be(sh, N, 8);
+  hash_uint_be(sh, n, 8);
+  for (int i = 0; i < n; i++) {
+    uint8_t bytes[BYTES_PER_FIELD_ELEMENT];
+    hash_bytes(sh, commitments[i].data(), commitments[i].size());
+    fr_to_bytes32(bytes, zs[i]);
+    hash_bytes(sh, bytes, sizeof(bytes));
+    fr_to_bytes32(bytes, ys[i]);
+    hash_bytes(sh, bytes, sizeof(bytes));
+    hash_bytes(sh, proofs[i].data(), proofs[i].size());
+  }
+
+  char digest[32];
+  HASH256_hash(&sh, digest);
+  fr r;
+  fr_from_digest(r, reinterpret_cast<uint8_t*>(digest));
+
+  // with r_i = r^i, the batch holds iff
+  // e(sum r_i proof_i, [s]2) = e(sum r_i C_i + sum r_i z_i proof_i - [sum r_i y_i]1, [1]2)
+  fr_vec scalars(2 * n);
+  fr r_i = FR.one, y_sum;
+  fr_zero(y_sum);
+  for (int i = 0; i < n; i++) {
+    fr term;
+    scalars[i] = r_i;
+    fr_mul(scalars[n + i], r_i, zs[i]);
+    fr_mul(term, r_i, ys[i]);
+    fr_add(y_sum, y_sum, term);
+    fr_mul(r_i, r_i, r);
+  }
+
+  ECP proof_lincomb, rhs, y_G1;
+  lincomb(proof_lincomb, &points[n], scalars.data(), n);
+  lincomb(rhs, points.data(), scalars.data(), 2 * n);
+
+  BIG BIG_y_sum;
+  fr_to_BIG(BIG_y_sum, y_sum);
+  ECP_generator(&y_G1);
+  mul_vartime_G1(y_G1, BIG_y_sum);
+  ECP_sub(&rhs, &y_G1);
+  ECP_neg(&rhs);
+
+  ECP2 G2;
+  ECP2_generator(&G2);
+  FP12 v;
+  PAIR_double_ate(&v, &_G2_monomial[1], &proof_lincomb, &G2, &rhs);
+  PAIR_fexp(&v);
+  return FP12_isunity(&v);
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <kzg.h>
+#include "util.h"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+kzg::blob kzg::blob::extend(const kzg::poly& poly, int num_chunks) {
+  if (num_chunks < 1)
+    throw invalid_argument("num_chunks must be 1 or greater");
+  else if (deg(poly.get_poly()) >= num_chunks)
+    throw invalid_argument("polynomial degree must be less than num_chunks");
+
+  vector<pair<ZZ_p, ZZ_p>> points;
+  evaluate_polynomial_points(points, poly.get_poly(), 0, 2 * num_chunks);
+  return kzg::blob(points);
+}
+
+kzg::poly kzg::poly::recover(std::vector<kzg::blob>& cells, int num_chunks) {
+  if (num_chunks < 1)
+    throw invalid_argument("num_chunks must be 1 or greater");
+
+  // the first point seen at each position fits the polynomial, the rest check it
+  ZZ extended_length = conv<ZZ>(2 * num_chunks);
+  std::vector<uint8_t> seen(2 * num_chunks);
+  vector<pair<ZZ_p, ZZ_p>> points, extra;
+  for (auto& cell : cells) {
+    for (auto& point : cell.get_data()) {
+      if (rep(point.first) >= extended_length)
+        throw invalid_argument("cell point outside of the extended data");
+
+      long x = conv<long>(rep(point.first));
+      if (seen[x] || (long) points.size() == num_chunks) {
+        extra.push_back(point);
+      } else {
+        seen[x] = 1;
+        points.push_back(point);
+      }
+    }
+  }
+
+  if ((long) points.size() < num_chunks)
+    throw invalid_argument("cells must cover at least half of the extended data");
+
+  kzg::workspace workspace;
+  ZZ_pX P;
+  polyfit(P, points, workspace.get_state());
+
+  if (!extra.empty()) {
+    vector<pair<ZZ_p, ZZ_p>> codeword;
+    evaluate_polynomial_points(codeword, P, 0, 2 * num_chunks);
+    for (auto& point : extra) {
+      if (codeword[conv<long>(rep(point.first))].second != point.second)
+        throw invalid_argument("cells are not consistent with each other");
+    }
+  }
+
+  return kzg::poly(P);
+}
+
+std::vector<kzg::proof> kzg::trusted_setup::create_cell_proofs(const kzg::poly& poly, int num_chunks, int cell_size) {
+  if (cell_size < 1 || (2 * num_chunks) % cell_size != 0)
+    throw invalid_argument("cell_size must be positive and divide the extended length");
+  else if (deg(poly.get_poly()) >= num_chunks)
+    throw invalid_argument("polynomial degree must be less than num_chunks");
+  else if (num_chunks >= (int) _G1.size())
+    throw invalid_argument("num_chunks must be less than the setup size (num_coeffs)");
+
+  size_t num_cells = 2 * num_chunks / cell_size;
+  const ZZ_pX& P = poly.get_poly();
+
+  // the vanishing polynomials of the cells are shifts of one falling factorial
+  vector<ZZ_p> fact, inv_fact;
+  factorials(fact, inv_fact, cell_size + 1);
+  ZZ_pX F;
+  falling_factorial(F, cell_size, fact, inv_fact);
+
+  // cells are independent, workers take their quotients off a shared counter
+  // with one workspace each
+  std::vector<kzg::poly> quotients(num_cells, kzg::poly(ZZ_pX()));
+  unsigned int num_threads = min<size_t>(kzg::PROFILE.thread_count(), num_cells);
+  std::atomic<size_t> next(0);
+  std::vector<std::exception_ptr> errors(num_threads);
+  ZZ_pContext context;
+  context.save();
+
+  auto worker = [&](unsigned int t) {
+    context.restore();
+    kzg::workspace workspace;
+    kzg::workspace::state& ws = workspace.get_state();
+    ws.threads = 1;
+
+    try {
+      for (size_t cell = next++; cell < num_cells; cell = next++) {
+        ZZ_p offset;
+        offset = cell * cell_size;
+        if (cell_size == 1) {
+          quotient_linear(ws.q, P, offset, ws);
+        } else {
+          taylor_shift(ws.Z, F, -offset, fact, inv_fact);
+          quotient_vanishing(ws.q, P, ws.Z, ws);
+        }
+        quotients[cell] = kzg::poly(ws.q);
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1; t < num_threads; t++)
+    threads.push_back(std::thread(worker, t));
+  worker(0);
+  for (auto& thread : threads)
+    thread.join();
+
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // the quotients are committed to together, sharing the passes over the
+  // setup or its fixed-base table instead of a full MSM per cell
+  std::vector<kzg::commit> commits = create_commits(quotients);
+  std::vector<kzg::proof> proofs;
+  proofs.reserve(num_cells);
+  for (auto& commit : commits)
+    proofs.push_back(kzg::proof(commit.get_curve_point()));
+
+  return proofs;
+}
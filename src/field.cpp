@@ -0,0 +1,305 @@
+#include "field.h"
+
+#include <stdexcept>
+#include <NTL/ZZ_limbs.h>
+
+fr_context FR;
+
+static_assert(sizeof(ZZ_limb_t) == sizeof(uint64_t), "NTL must be built with 64-bit limbs");
+
+void limbs_from_BIG(uint64_t* limbs, const BIG big) {
+  for (int i = 0; i < FR_LIMBS; i++)
+    limbs[i] = 0;
+
+  for (int i = 0; i < NLEN_CURVE; i++) {
+    uint64_t bits = (uint64_t) big[i];
+    int bit = i * BASEBITS_CURVE;
+    int w = bit / 64;
+    int o = bit % 64;
+
+    if (w < FR_LIMBS)
+      limbs[w] |= bits << o;
+    if (o + BASEBITS_CURVE > 64 && w + 1 < FR_LIMBS)
+      limbs[w + 1] |= bits >> (64 - o);
+  }
+}
+
+void BIG_from_limbs(BIG big, const uint64_t* limbs) {
+  const uint64_t mask = (((uint64_t) 1) << BASEBITS_CURVE) - 1;
+
+  for (int i = 0; i < NLEN_CURVE; i++) {
+    int bit = i * BASEBITS_CURVE;
+    int w = bit / 64;
+    int o = bit % 64;
+
+    uint64_t bits = 0;
+    if (w < FR_LIMBS)
+      bits = limbs[w] >> o;
+    if (o + BASEBITS_CURVE > 64 && w + 1 < FR_LIMBS)
+      bits |= limbs[w + 1] << (64 - o);
+
+    big[i] = (chunk) (bits & mask);
+  }
+}
+
+void limbs_from_ZZ(uint64_t* limbs, const ZZ& value) {
+  const ZZ_limb_t* data = ZZ_limbs_get(value);
+  long n = value.size();
+
+  for (int i = 0; i < FR_LIMBS; i++)
+    limbs[i] = (i < n) ? data[i] : 0;
+}
+
+void ZZ_from_limbs(ZZ& value, const uint64_t* limbs) {
+  long n = FR_LIMBS;
+  while (n > 0 && limbs[n - 1] == 0)
+    n--;
+
+  ZZ_limbs_set(value, (const ZZ_limb_t*) limbs, n);
+}
+
+// a = 2a mod r on canonical limbs
+static void limbs_double_mod(uint64_t* a) {
+  uint64_t carry = 0;
+  for (int i = 0; i < FR_LIMBS; i++) {
+    uint64_t next = a[i] >> 63;
+    a[i] = (a[i] << 1) | carry;
+    carry = next;
+  }
+  if (carry || fr_geq_modulus(a))
+    fr_sub_modulus(a);
+}
+
+void fr_init() {
+  limbs_from_BIG(FR.modulus, CURVE_Order);
+
+  // Newton iteration for modulus^-1 mod 2^64, each step doubles the correct bits
+  uint64_t inv = 1;
+  for (int i = 0; i < 6; i++)
+    inv *= 2 - FR.modulus[0] * inv;
+  FR.inv = -inv;
+
+  uint64_t borrow = 2;
+  for (int i = 0; i < FR_LIMBS; i++) {
+    unsigned __int128 d = (unsigned __int128) FR.modulus[i] - borrow;
+    FR.modulus_minus_2[i] = (uint64_t) d;
+    borrow = (uint64_t) (d >> 64) & 1;
+  }
+
+  // 2^(64 * FR_LIMBS) mod r is one in Montgomery form, doubling it as many
+  // times again gives the conversion constant
+  uint64_t acc[FR_LIMBS] = {1};
+  for (int i = 0; i < 64 * FR_LIMBS; i++)
+    limbs_double_mod(acc);
+  for (int i = 0; i < FR_LIMBS; i++)
+    FR.one.v[i] = acc[i];
+
+  for (int i = 0; i < 64 * FR_LIMBS; i++)
+    limbs_double_mod(acc);
+  for (int i = 0; i < FR_LIMBS; i++)
+    FR.r2.v[i] = acc[i];
+}
+
+void fr_from_u64(fr& r, uint64_t value) {
+  fr_zero(r);
+  r.v[0] = value;
+  if (fr_geq_modulus(r.v))
+    fr_sub_modulus(r.v);
+  fr_mul(r, r, FR.r2);
+}
+
+void fr_from_limbs(fr& r, const uint64_t* limbs) {
+  for (int i = 0; i < FR_LIMBS; i++)
+    r.v[i] = limbs[i];
+  if (fr_geq_modulus(r.v))
+    fr_sub_modulus(r.v);
+  fr_mul(r, r, FR.r2);
+}
+
+void fr_to_limbs(uint64_t* limbs, const fr& a) {
+  fr unit;
+  fr_zero(unit);
+  unit.v[0] = 1;
+
+  fr res;
+  fr_mul(res, a, unit);
+  for (int i = 0; i < FR_LIMBS; i++)
+    limbs[i] = res.v[i];
+}
+
+void fr_from_ZZ_p(fr& r, const ZZ_p& value) {
+  uint64_t limbs[FR_LIMBS];
+  limbs_from_ZZ(limbs, rep(value));
+  fr_from_limbs(r, limbs);
+}
+
+void fr_to_ZZ_p(ZZ_p& r, const fr& a) {
+  uint64_t limbs[FR_LIMBS];
+  fr_to_limbs(limbs, a);
+
+  ZZ value;
+  ZZ_from_limbs(value, limbs);
+  conv(r, value);
+}
+
+void fr_vec_from_ZZ_p(fr_vec& r, const ZZ_p* values, size_t n) {
+  r.resize(n);
+  uint64_t limbs[FR_LIMBS];
+  for (size_t i = 0; i < n; i++) {
+    limbs_from_ZZ(limbs, rep(values[i]));
+    fr_from_limbs(r[i], limbs);
+  }
+}
+
+// One ZZ is reused for the whole array instead of one per element
+void fr_vec_to_ZZ_p(ZZ_p* r, const fr_vec& a) {
+  uint64_t limbs[FR_LIMBS];
+  ZZ value;
+  for (size_t i = 0; i < a.size(); i++) {
+    fr_to_limbs(limbs, a[i]);
+    ZZ_from_limbs(value, limbs);
+    conv(r[i], value);
+  }
+}
+
+void fr_from_BIG(fr& r, const BIG big) {
+  uint64_t limbs[FR_LIMBS];
+  limbs_from_BIG(limbs, big);
+  fr_from_limbs(r, limbs);
+}
+
+void fr_to_BIG(BIG big, const fr& a) {
+  uint64_t limbs[FR_LIMBS];
+  fr_to_limbs(limbs, a);
+  BIG_from_limbs(big, limbs);
+}
+
+void fr_pow(fr& r, const fr& a, const uint64_t* exponent, int exponent_limbs) {
+  fr base = a;
+  fr res = FR.one;
+
+  for (int i = 0; i < exponent_limbs; i++) {
+    uint64_t e = exponent[i];
+    for (int j = 0; j < 64; j++) {
+      if (e & 1)
+        fr_mul(res, res, base);
+      fr_mul(base, base, base);
+      e >>= 1;
+    }
+  }
+
+  r = res;
+}
+
+void fr_inv(fr& r, const fr& a) {
+  fr_pow(r, a, FR.modulus_minus_2, FR_LIMBS);
+}
+
+// Montgomery's trick: prefix products, one inversion, then unwinding the
+// prefixes from the end costs 3(n - 1) multiplications in total.
+void fr_batch_inv(fr* r, const fr* a, size_t n) {
+  if (n == 0)
+    return;
+  
+  fr_vec prefix(n);
+  prefix[0] = a[0];
+  for (size_t i = 1; i < n; i++)
+    fr_mul(prefix[i], prefix[i - 1], a[i]);
+  
+  fr inv;
+  fr_inv(inv, prefix[n - 1]);
+  for (size_t i = n - 1; i > 0; i--) {
+    fr a_inv;
+    fr_mul(a_inv, inv, prefix[i - 1]);
+    fr_mul(inv, inv, a[i]);
+    r[i] = a_inv;
+  }
+  r[0] = inv;
+}
+
+void fr_batch_add(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    fr_add(r[i], a[i], b[i]);
+}
+
+void fr_batch_sub(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    fr_sub(r[i], a[i], b[i]);
+}
+
+void fr_batch_mul(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    fr_mul(r[i], a[i], b[i]);
+}
+
+void fr_batch_scale(fr* __restrict r, const fr* __restrict a, const fr& s, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    fr_mul(r[i], a[i], s);
+}
+
+void fr_batch_from_ZZ_pX(fr_vec& r, const ZZ_pX& P) {
+  long n = deg(P) + 1;
+  r.resize(n);
+  for (long i = 0; i < n; i++)
+    fr_from_ZZ_p(r[i], P[i]);
+}
+
+void fr_horner(fr& r, const fr* coeffs, size_t n, const fr& x) {
+  fr acc;
+  fr_zero(acc);
+
+  for (size_t i = n; i-- > 0;) {
+    fr_mul(acc, acc, x);
+    fr_add(acc, acc, coeffs[i]);
+  }
+
+  r = acc;
+}
+
+void fr_batch_inv(fr_vec& r, const fr_vec& a) {
+  r.resize(a.size());
+  fr_batch_inv(r.data(), a.data(), a.size());
+}
+
+// No __restrict here, so the result can overwrite an operand
+void fr_batch_add(fr_vec& r, const fr_vec& a, const fr_vec& b) {
+  if (a.size() != b.size())
+    throw invalid_argument("operands differ in size");
+  r.resize(a.size());
+  for (size_t i = 0; i < a.size(); i++)
+    fr_add(r[i], a[i], b[i]);
+}
+
+void fr_batch_sub(fr_vec& r, const fr_vec& a, const fr_vec& b) {
+  if (a.size() != b.size())
+    throw invalid_argument("operands differ in size");
+  r.resize(a.size());
+  for (size_t i = 0; i < a.size(); i++)
+    fr_sub(r[i], a[i], b[i]);
+}
+
+void fr_batch_mul(fr_vec& r, const fr_vec& a, const fr_vec& b) {
+  if (a.size() != b.size())
+    throw invalid_argument("operands differ in size");
+  r.resize(a.size());
+  for (size_t i = 0; i < a.size(); i++)
+    fr_mul(r[i], a[i], b[i]);
+}
+
+void fr_batch_scale(fr_vec& r, const fr_vec& a, const fr& s) {
+  r.resize(a.size());
+  for (size_t i = 0; i < a.size(); i++)
+    fr_mul(r[i], a[i], s);
+}
+
+void fr_horner(fr& r, const fr_vec& coeffs, const fr& x) {
+  fr_horner(r, coeffs.data(), coeffs.size(), x);
+}
+
+void fr_sum(fr& r, const fr_vec& a) {
+  fr acc;
+  fr_zero(acc);
+  for (const fr& x : a)
+    fr_add(acc, acc, x);
+  r = acc;
+}
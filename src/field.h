@@ -0,0 +1,185 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <NTL/ZZ_pX.h>
+#include <kzg_config.h>
+
+using namespace std;
+using namespace NTL;
+
+// Number of 64-bit limbs needed to hold any scalar of the configured curve.
+#define FR_LIMBS ((MODBYTES_CURVE + 7) / 8)
+
+// Element of the scalar field (integers modulo the curve order), stored on the
+// stack in Montgomery form x * 2^(64 * FR_LIMBS) mod r.
+struct fr {
+  uint64_t v[FR_LIMBS];
+};
+
+struct fr_context {
+  uint64_t modulus[FR_LIMBS];
+  uint64_t modulus_minus_2[FR_LIMBS];
+  uint64_t inv;  // -modulus^-1 mod 2^64
+  fr r2;         // 2^(128 * FR_LIMBS) mod r, used to enter Montgomery form
+  fr one;
+};
+
+extern fr_context FR;
+
+// Computes the Montgomery constants for the curve order. Called by kzg::init().
+void fr_init();
+
+static inline bool fr_geq_modulus(const uint64_t* a) {
+  for (int i = FR_LIMBS - 1; i >= 0; i--) {
+    if (a[i] != FR.modulus[i])
+      return a[i] > FR.modulus[i];
+  }
+  return true;
+}
+
+static inline void fr_sub_modulus(uint64_t* a) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < FR_LIMBS; i++) {
+    unsigned __int128 d = (unsigned __int128) a[i] - FR.modulus[i] - borrow;
+    a[i] = (uint64_t) d;
+    borrow = (uint64_t) (d >> 64) & 1;
+  }
+}
+
+static inline void fr_add(fr& r, const fr& a, const fr& b) {
+  uint64_t carry = 0;
+  for (int i = 0; i < FR_LIMBS; i++) {
+    unsigned __int128 s = (unsigned __int128) a.v[i] + b.v[i] + carry;
+    r.v[i] = (uint64_t) s;
+    carry = (uint64_t) (s >> 64);
+  }
+  if (carry || fr_geq_modulus(r.v))
+    fr_sub_modulus(r.v);
+}
+
+static inline void fr_sub(fr& r, const fr& a, const fr& b) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < FR_LIMBS; i++) {
+    unsigned __int128 d = (unsigned __int128) a.v[i] - b.v[i] - borrow;
+    r.v[i] = (uint64_t) d;
+    borrow = (uint64_t) (d >> 64) & 1;
+  }
+  if (borrow) {
+    uint64_t carry = 0;
+    for (int i = 0; i < FR_LIMBS; i++) {
+      unsigned __int128 s = (unsigned __int128) r.v[i] + FR.modulus[i] + carry;
+      r.v[i] = (uint64_t) s;
+      carry = (uint64_t) (s >> 64);
+    }
+  }
+}
+
+// Montgomery multiplication (CIOS): r = a * b / 2^(64 * FR_LIMBS) mod r
+static inline void fr_mul(fr& r, const fr& a, const fr& b) {
+  uint64_t t[FR_LIMBS + 2] = {0};
+
+  for (int i = 0; i < FR_LIMBS; i++) {
+    unsigned __int128 c = 0;
+    for (int j = 0; j < FR_LIMBS; j++) {
+      c += (unsigned __int128) a.v[j] * b.v[i] + t[j];
+      t[j] = (uint64_t) c;
+      c >>= 64;
+    }
+    c += t[FR_LIMBS];
+    t[FR_LIMBS] = (uint64_t) c;
+    t[FR_LIMBS + 1] = (uint64_t) (c >> 64);
+
+    uint64_t m = t[0] * FR.inv;
+    c = (unsigned __int128) m * FR.modulus[0] + t[0];
+    c >>= 64;
+    for (int j = 1; j < FR_LIMBS; j++) {
+      c += (unsigned __int128) m * FR.modulus[j] + t[j];
+      t[j - 1] = (uint64_t) c;
+      c >>= 64;
+    }
+    c += t[FR_LIMBS];
+    t[FR_LIMBS - 1] = (uint64_t) c;
+    t[FR_LIMBS] = t[FR_LIMBS + 1] + (uint64_t) (c >> 64);
+  }
+
+  if (t[FR_LIMBS] || fr_geq_modulus(t))
+    fr_sub_modulus(t);
+  for (int i = 0; i < FR_LIMBS; i++)
+    r.v[i] = t[i];
+}
+
+static inline void fr_zero(fr& r) {
+  for (int i = 0; i < FR_LIMBS; i++)
+    r.v[i] = 0;
+}
+
+static inline bool fr_is_zero(const fr& a) {
+  uint64_t acc = 0;
+  for (int i = 0; i < FR_LIMBS; i++)
+    acc |= a.v[i];
+  return acc == 0;
+}
+
+static inline bool fr_equals(const fr& a, const fr& b) {
+  uint64_t acc = 0;
+  for (int i = 0; i < FR_LIMBS; i++)
+    acc |= a.v[i] ^ b.v[i];
+  return acc == 0;
+}
+
+static inline void fr_neg(fr& r, const fr& a) {
+  fr zero;
+  fr_zero(zero);
+  fr_sub(r, zero, a);
+}
+
+// Conversions between FR_LIMBS little-endian 64-bit limbs and other representations
+void limbs_from_BIG(uint64_t* limbs, const BIG big);
+void BIG_from_limbs(BIG big, const uint64_t* limbs);
+void limbs_from_ZZ(uint64_t* limbs, const ZZ& value);
+void ZZ_from_limbs(ZZ& value, const uint64_t* limbs);
+
+void fr_from_u64(fr& r, uint64_t value);
+void fr_from_limbs(fr& r, const uint64_t* limbs);
+void fr_to_limbs(uint64_t* limbs, const fr& a);
+void fr_from_ZZ_p(fr& r, const ZZ_p& value);
+void fr_to_ZZ_p(ZZ_p& r, const fr& a);
+void fr_from_BIG(fr& r, const BIG big);
+void fr_to_BIG(BIG big, const fr& a);
+void fr_pow(fr& r, const fr& a, const uint64_t* exponent, int exponent_limbs);
+void fr_inv(fr& r, const fr& a);
+
+// Inverts n nonzero elements with a single inversion, r may alias a.
+void fr_batch_inv(fr* r, const fr* a, size_t n);
+
+// Contiguous array of field elements
+typedef vector<fr> fr_vec;
+
+// Whole-array conversions from and to NTL, r is resized to n
+void fr_vec_from_ZZ_p(fr_vec& r, const ZZ_p* values, size_t n);
+void fr_vec_to_ZZ_p(ZZ_p* r, const fr_vec& a);
+
+// Batch operations over contiguous arrays of n elements.
+void fr_batch_add(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n);
+void fr_batch_sub(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n);
+void fr_batch_mul(fr* __restrict r, const fr* __restrict a, const fr* __restrict b, size_t n);
+void fr_batch_scale(fr* __restrict r, const fr* __restrict a, const fr& s, size_t n);
+void fr_batch_from_ZZ_pX(fr_vec& r, const ZZ_pX& P);
+void fr_horner(fr& r, const fr* coeffs, size_t n, const fr& x);
+
+// The same over whole arrays of equal size, r is resized to match and may be
+// one of the operands. Operands of different sizes throw invalid_argument.
+void fr_batch_inv(fr_vec& r, const fr_vec& a);
+void fr_batch_add(fr_vec& r, const fr_vec& a, const fr_vec& b);
+void fr_batch_sub(fr_vec& r, const fr_vec& a, const fr_vec& b);
+void fr_batch_mul(fr_vec& r, const fr_vec& a, const fr_vec& b);
+void fr_batch_scale(fr_vec& r, const fr_vec& a, const fr& s);
+void fr_horner(fr& r, const fr_vec& coeffs, const fr& x);
+
+// Sum of the elements
+void fr_sum(fr& r, const fr_vec& a);
+
+#endif
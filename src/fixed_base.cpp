@@ -0,0 +1,215 @@
+#include <kzg.h>
+#include "util.h"
+#include "msm.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Saved fixed-base table: a header, then the points, entry k of element i at
+// i * copies + k. Each point is its x and y coordinates as MODBYTES_CURVE
+// bytes, least significant first, and every integer in the header is written
+// byte by byte in little-endian order, so the file does not depend on the host
+// or on the library's limb layout. The digest covers these bytes.
+//
+// The table is trusted like the setup it extends. Its unshifted copies are
+// compared with the setup and a digest of the points is checked, which catches
+// a damaged or mismatched file, but a table edited together with its digest
+// is only caught by verifying the commitments made with it.
+
+static const char PRECOMPUTED_MAGIC[8] = { 'K', 'Z', 'G', 'P', 'R', 'E', '0', '3' };
+static constexpr size_t POINT_SIZE = 2 * MODBYTES_CURVE;
+
+// Elements shifted and normalized together
+static constexpr size_t PRECOMPUTE_BLOCK_SIZE = 64;
+
+struct precomputed_header {
+  char magic[8];
+  uint8_t point_size[4];
+  uint8_t stride[4];
+  uint8_t copies[4];
+  uint8_t reserved[4];
+  uint8_t num_coeff[8];
+  char modulus[MODBYTES_CURVE];
+  char digest[32];
+};
+
+static constexpr size_t DATA_OFFSET = ((sizeof(precomputed_header) + 63) / 64) * 64;
+
+// A piece above the top one would be zero, one more copy than whole strides
+// leaves room for the carry out of the signed digits
+static int shifted_copies(int stride) {
+  BIG order;
+  BIG_rcopy(order, CURVE_Order);
+  return BIG_nbits(order) / stride + 1;
+}
+
+static void shift(ECP& P, int bits) {
+  for (int j = 0; j < bits; j++)
+    ECP_dbl(&P);
+}
+
+static void store_le(uint8_t* bytes, uint64_t value, int width) {
+  for (int i = 0; i < width; i++)
+    bytes[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t load_le(const uint8_t* bytes, int width) {
+  uint64_t value = 0;
+  for (int i = 0; i < width; i++)
+    value |= (uint64_t) bytes[i] << (8 * i);
+  return value;
+}
+
+// x out of Montgomery form, as MODBYTES_CURVE little-endian bytes
+static void store_FP(uint8_t* bytes, const FP& x) {
+  BIG value;
+  char be[MODBYTES_CURVE];
+  FP_redc(value, const_cast<FP*>(&x));
+  BIG_toBytes(be, value);
+  for (int i = 0; i < MODBYTES_CURVE; i++)
+    bytes[i] = (uint8_t) be[MODBYTES_CURVE - 1 - i];
+}
+
+static bool load_FP(FP& x, const uint8_t* bytes, BIG modulus) {
+  BIG value;
+  char be[MODBYTES_CURVE];
+  for (int i = 0; i < MODBYTES_CURVE; i++)
+    be[i] = (char) bytes[MODBYTES_CURVE - 1 - i];
+  BIG_fromBytesLen(value, be, MODBYTES_CURVE);
+  if (BIG_comp(value, modulus) >= 0)
+    return false;
+  FP_nres(&x, value);
+  return true;
+}
+
+void kzg::trusted_setup::precompute_G1(int stride) {
+  if (stride < 2)
+    throw invalid_argument("stride must be at least 2");
+  
+  size_t n = _G1.size();
+  int copies = shifted_copies(stride);
+  point_table<G1_affine> table;
+  table.allocate(n * copies);
+  
+  parallel_ranges((n + PRECOMPUTE_BLOCK_SIZE - 1) / PRECOMPUTE_BLOCK_SIZE, [&](uint64_t begin, uint64_t end) {
+    std::vector<ECP> points(PRECOMPUTE_BLOCK_SIZE * copies);
+    for (uint64_t block = begin; block < end; block++) {
+      size_t start = block * PRECOMPUTE_BLOCK_SIZE;
+      size_t count = std::min(PRECOMPUTE_BLOCK_SIZE, n - start);
+      for (size_t i = 0; i < count; i++) {
+        ECP P;
+        ECP_from_affine(P, _G1[start + i]);
+        for (int k = 0; k < copies; k++) {
+          if (k > 0)
+            shift(P, stride);
+          ECP_copy(&points[i * copies + k], &P);
+        }
+      }
+      normalize_G1(&table[start * copies], points.data(), count * copies);
+    }
+  });
+  
+  _G1_shifted = table;
+  _G1_stride = stride;
+}
+
+void kzg::trusted_setup::save_precomputed(const std::string& filename) const {
+  if (_G1_stride == 0)
+    throw runtime_error("no precomputed table to save");
+  
+  size_t entries = _G1_shifted.size();
+  std::vector<uint8_t> points(entries * POINT_SIZE);
+  parallel_ranges(entries, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; i++) {
+      store_FP(&points[i * POINT_SIZE], _G1_shifted[i].x);
+      store_FP(&points[i * POINT_SIZE + MODBYTES_CURVE], _G1_shifted[i].y);
+    }
+  });
+  
+  precomputed_header header = {};
+  memcpy(header.magic, PRECOMPUTED_MAGIC, sizeof(PRECOMPUTED_MAGIC));
+  store_le(header.point_size, POINT_SIZE, sizeof(header.point_size));
+  store_le(header.stride, _G1_stride, sizeof(header.stride));
+  store_le(header.copies, entries / _G1.size(), sizeof(header.copies));
+  store_le(header.num_coeff, _G1.size(), sizeof(header.num_coeff));
+  curve_modulus(header.modulus);
+  block_sha256(header.digest, points.data(), points.size());
+  
+  std::string tmp_filename = filename + ".tmp";
+  std::ofstream file(tmp_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw runtime_error("could not write precomputed table");
+  
+  std::vector<char> padding(DATA_OFFSET - sizeof(header), 0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(padding.data(), padding.size());
+  file.write(reinterpret_cast<const char*>(points.data()), points.size());
+  file.close();
+  if (!file || std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    throw runtime_error("could not write precomputed table");
+  }
+}
+
+void kzg::trusted_setup::load_precomputed(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("could not open precomputed table");
+  
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t) DATA_OFFSET)
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw runtime_error("bad precomputed table");
+  
+  size_t length = st.st_size;
+  std::shared_ptr<void> mapping(addr, [length](void* p) { munmap(p, length); });
+  const precomputed_header* header = static_cast<const precomputed_header*>(addr);
+  const uint8_t* points = static_cast<const uint8_t*>(addr) + DATA_OFFSET;
+  uint64_t stride = load_le(header->stride, sizeof(header->stride));
+  uint64_t copies = load_le(header->copies, sizeof(header->copies));
+  
+  char modulus[MODBYTES_CURVE];
+  curve_modulus(modulus);
+  size_t n = _G1.size();
+  if (memcmp(header->magic, PRECOMPUTED_MAGIC, sizeof(PRECOMPUTED_MAGIC)) != 0
+      || load_le(header->point_size, sizeof(header->point_size)) != POINT_SIZE
+      || memcmp(header->modulus, modulus, sizeof(modulus)) != 0
+      || stride < 2 || stride > INT_MAX || copies != (uint64_t) shifted_copies(stride)
+      || load_le(header->num_coeff, sizeof(header->num_coeff)) != n
+      || length - DATA_OFFSET < n * copies * POINT_SIZE)
+    throw runtime_error("bad precomputed table");
+  
+  char digest[32];
+  block_sha256(digest, points, n * copies * POINT_SIZE);
+  if (memcmp(header->digest, digest, sizeof(digest)) != 0)
+    throw runtime_error("precomputed table is corrupt");
+  
+  BIG p;
+  BIG_rcopy(p, Modulus);
+  point_table<G1_affine> table;
+  table.allocate(n * copies);
+  parallel_ranges(n * copies, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; i++) {
+      if (!load_FP(table[i].x, &points[i * POINT_SIZE], p) || !load_FP(table[i].y, &points[i * POINT_SIZE + MODBYTES_CURVE], p))
+        throw runtime_error("bad precomputed table");
+    }
+  });
+  
+  for (size_t i = 0; i < n; i++) {
+    const G1_affine& entry = table[i * copies];
+    if (!FP_equals(const_cast<FP*>(&entry.x), const_cast<FP*>(&_G1[i].x)) || !FP_equals(const_cast<FP*>(&entry.y), const_cast<FP*>(&_G1[i].y)))
+      throw runtime_error("precomputed table is for another setup");
+  }
+  
+  _G1_shifted = table;
+  _G1_stride = stride;
+}
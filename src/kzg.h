@@ -3,7 +3,11 @@
 
 #include <kzg_config.h>
 
+#include <cstdlib>
 #include <vector>
+#include <string>
+#include <memory>
+#include <new>
 #include <NTL/ZZX.h>
 
 using namespace std;
@@ -30,13 +34,116 @@ extern int CURVE_ORDER_BYTES;
 
 #define MAX_CHUNK_BYTES (kzg::CURVE_ORDER_BYTES - 1)
 
+/**
+* @brief Algorithm thresholds and thread counts used by the library
+*
+* The crossover points between algorithms depend on the curve and the machine.
+* The defaults are reasonable everywhere, but a profile measured with
+* kzg::profile::calibrate (or `kzg-cli calibrate`) can be saved once per machine
+* type and loaded with kzg::init.
+*/
+class profile {
+public:
+  /// Windows shorter than this are evaluated point by point rather than by falling factorial products
+  int fast_multieval_threshold = 140;
+  /// Vanishing polynomials of at least this degree are divided by using a Newton reciprocal
+  int reciprocal_div_threshold = 64;
+  /// Vanishing polynomials of at least this degree are divided by using a precomputed FFT modulus
+  int ntt_div_threshold = 1024;
+  /// G1 multi-scalar multiplications of at least this many terms use the bucket method
+  int msm_g1_threshold = 32;
+  /// G2 multi-scalar multiplications of at least this many terms use the bucket method
+  int msm_g2_threshold = 128;
+  /// The bucket method uses windows of log2(terms) - msm_window_offset bits
+  int msm_window_offset = 2;
+  /// Number of worker threads, 0 uses the hardware concurrency
+  int num_threads = 0;
+  /// Subproduct tree and falling factorial ranges of at least this many points are split across threads
+  int parallel_grain = 1024;
+  /// Number of verification windows whose vanishing polynomial and [Z(s)]₂ are kept per setup
+  int verify_cache_size = 256;
+  
+  /**
+  * @brief Number of worker threads to use
+  * 
+  * @return num_threads if set, otherwise the hardware concurrency
+  */
+  unsigned int thread_count() const;
+  
+  /**
+  * @brief Loads a profile written by kzg::profile::save
+  * 
+  * @param filename Path to the profile
+  * @return The loaded profile
+  * @throws runtime_error for an inaccessible file, a profile made for another curve,
+  * or values out of range (num_threads below 1, negative thresholds or window offsets)
+  */
+  static profile load(const std::string& filename);
+  
+  /**
+  * @brief Writes the profile to a text file
+  * 
+  * @param filename Path where the profile should be written
+  * @throws runtime_error if the file cannot be written
+  */
+  void save(const std::string& filename) const;
+  
+  /**
+  * @brief Measures the thresholds on this machine
+  * 
+  * Times each pair of competing algorithms over a range of sizes and picks the
+  * crossover points. This takes a few minutes.
+  * 
+  * @param verbose Print measurements to stdout as they are taken
+  * @return The calibrated profile
+  */
+  static profile calibrate(bool verbose = false);
+};
+
+/**
+* @brief The profile currently in use by the library
+*/
+extern profile PROFILE;
+
 /**
 * @brief Initialize the library
 *
-* This function must be called prior to any other library function.
+* This function must be called prior to any other library function. If the
+* KZG_PROFILE environment variable is set, the profile it names is loaded.
 */
 void init();
 
+/**
+* @brief Initialize the library with a calibrated profile
+*
+* @param profile_filename Path to a profile written by kzg::profile::save
+* @throws runtime_error if the profile cannot be loaded
+*/
+void init(const std::string& profile_filename);
+
+/**
+* @brief Reusable scratch memory for interpolation and proof generation
+*
+* Polynomials and vectors used as temporaries by poly::from_blob,
+* trusted_setup::create_proof and trusted_setup::verify_proof are kept in the
+* workspace, so passing the same workspace to back-to-back calls of similar
+* size avoids allocating them again. A workspace must not be used by two
+* threads at the same time, give each thread its own.
+*/
+class workspace {
+public:
+  struct state;
+  
+  workspace();
+  state& get_state() { return *_state; }
+
+private:
+  std::shared_ptr<state> _state;
+};
+
+class poly;
+class trusted_setup;
+
 class blob {
 private:
   vector<pair<ZZ_p, ZZ_p>> data;
@@ -84,8 +191,96 @@ public:
   * @throws invalid_argument if parameters don't meet the required constraints
   */
   static blob from_bytes(const uint8_t* bytes, int byte_offset, int byte_length, int chunk_size);
+  
+  /**
+  * @brief Generate a vector of evaluation points for a set of chunks at arbitrary positions
+  *
+  * Use this function to verify a proof created for a set of chunk indices.
+  *
+  * @param bytes The chunks, chunk_size bytes each, in the order of chunk_indices
+  * @param chunk_indices The chunk position of each chunk in bytes
+  * @param chunk_size The number of bytes that each point represents (must be at most MAX_CHUNK_BYTES)
+  * @return A blob object containing the vector of evaluation points
+  * @throws invalid_argument if chunk_size is too large or an index is negative
+  */
+  static blob from_bytes(const uint8_t* bytes, const std::vector<int>& chunk_indices, int chunk_size);
+  
+  /**
+  * @brief Generate a vector of evaluation points packing a buffer of bytes
+  *
+  * Fills each point with chunk_size bytes, as blob::from_bytes does, but
+  * takes a buffer of any length: a trailing partial chunk is encoded as if
+  * zero padded. The padding is not recorded, so the byte length has to be
+  * known separately to tell trailing zero bytes apart.
+  *
+  * @param bytes The bytes to encode, starting at chunk chunk_offset
+  * @param length The number of bytes to encode
+  * @param chunk_offset The chunk position of the first byte
+  * @param chunk_size The number of bytes that each point represents (must be at most MAX_CHUNK_BYTES)
+  * @return A blob object with one point per started chunk
+  * @throws invalid_argument if chunk_size is out of range or chunk_offset is negative
+  */
+  static blob from_bytes_packed(const uint8_t* bytes, size_t length, int chunk_offset = 0, int chunk_size = MAX_CHUNK_BYTES);
+  
+  /**
+  * @brief Generate a vector of evaluation points packing a string
+  *
+  * Like blob::from_string, but with MAX_CHUNK_BYTES characters per point
+  * instead of one, so the polynomial is that many times smaller.
+  *
+  * @param s The string to construct a blob from
+  * @param chunk_offset The chunk position of the first character
+  * @return A blob object with one point per started chunk
+  */
+  static blob from_string_packed(const string& s, int chunk_offset = 0);
+  
+  /**
+  * @brief Maps a byte range onto the chunks that hold it
+  *
+  * Proofs are made over whole chunks, this gives the window to prove or
+  * verify for any range of bytes of packed data.
+  *
+  * @param byte_offset The first byte of the range
+  * @param byte_length The number of bytes in the range (must be positive)
+  * @param chunk_size The number of bytes that each point represents
+  * @return The first chunk and the number of chunks of the window
+  * @throws invalid_argument if the range is empty, chunk_size is not positive
+  * or the window does not fit in int chunk indices
+  */
+  static std::pair<int, int> chunk_window(uint64_t byte_offset, uint64_t byte_length, int chunk_size = MAX_CHUNK_BYTES);
+  
+  /**
+  * @brief Evaluates the polynomial through the blob's points at z
+  * 
+  * Uses the barycentric formula on the points directly, so the polynomial
+  * is never interpolated. This gives the expected value for
+  * kzg::trusted_setup::verify_opening when the data is held as a blob.
+  * 
+  * @param z The evaluation point
+  * @return The value at z of the polynomial fitting the blob
+  * @throws invalid_argument if the blob is empty
+  */
+  ZZ_p evaluate(const ZZ_p& z);
+  
+  /**
+  * @brief Reed-Solomon extension of data to twice as many points
+  * 
+  * The data's num_chunks points at x = 0..num_chunks-1 are the evaluations
+  * of its polynomial, which is evaluated further up to x = 2 num_chunks - 1.
+  * Any half of the extended points determine the data again (see
+  * poly::recover). Cells of the extension are runs of consecutive points,
+  * proven with trusted_setup::create_cell_proofs.
+  * 
+  * @param poly The polynomial of the data
+  * @param num_chunks The number of points of the data
+  * @return The 2 num_chunks points of the extended data
+  * @throws invalid_argument if the polynomial does not fit num_chunks points
+  */
+  static blob extend(const poly& poly, int num_chunks);
 };
 
+class commit;
+
 class poly {
 private:
   ZZ_pX data;
@@ -101,8 +296,19 @@ public:
   * 
   * @param blob The evaluation points that you want to generate a polynomial for
   * @return The polynomial fitted to the evaluation points
+  * @throws invalid_argument if the blob is empty or two points share an x coordinate
   */
   static poly from_blob(blob blob);
+  
+  /**
+  * @brief Constructs a polynomial fitting the evaluation points in a blob
+  * 
+  * @param blob The evaluation points that you want to generate a polynomial for
+  * @param workspace Scratch memory reused across calls
+  * @return The polynomial fitted to the evaluation points
+  * @throws invalid_argument if the blob is empty or two points share an x coordinate
+  */
+  static poly from_blob(blob& blob, workspace& workspace);
 
   /**
   * @brief Serialize the polynomial into bytes
@@ -122,6 +328,52 @@ public:
   * @return The deserialized polynomial object
   */
   static poly deserialize(const std::vector<uint8_t>&);
+  
+  /**
+  * @brief Writes the polynomial to a cache file keyed by its commitment
+  * 
+  * Coefficients are stored at a fixed width, so load_cache maps the file and
+  * converts them in parallel instead of interpolating the data again. The
+  * file is replaced atomically.
+  * 
+  * @param filename The cache file
+  * @param commit The commitment to this polynomial
+  * @param setup The trusted setup the commitment was made with
+  * @throws invalid_argument if commit is not the commitment to this polynomial
+  * @throws runtime_error if the file cannot be written
+  */
+  void save_cache(const std::string& filename, commit& commit, trusted_setup& setup) const;
+  
+  /**
+  * @brief Recovers the polynomial of extended data from any half of its points
+  * 
+  * The first num_chunks distinct points are interpolated and any further
+  * points are checked against the result. The original data are the values
+  * of the polynomial at x = 0..num_chunks-1, as given by blob::extend.
+  * 
+  * @param cells Blobs of points of the data extended by blob::extend
+  * @param num_chunks The number of points of the original data
+  * @return The polynomial of the original data
+  * @throws invalid_argument if the cells hold fewer than num_chunks distinct
+  * points, points outside the extension, or points that disagree
+  */
+  static poly recover(std::vector<blob>& cells, int num_chunks);
+  
+  /**
+  * @brief Loads a polynomial written by save_cache
+  * 
+  * The coefficients are committed to again and compared with commit, so a
+  * cache that was tampered with is rejected. This costs one multi-scalar
+  * multiplication, still far less than interpolating the data.
+  * 
+  * @param filename The cache file
+  * @param commit The commitment the polynomial is expected to have
+  * @param setup The trusted setup the commitment was made with
+  * @return The cached polynomial
+  * @throws runtime_error if the file is missing, corrupt, from a build for
+  * another curve, or its coefficients do not have the commitment commit
+  */
+  static poly load_cache(const std::string& filename, commit& commit, trusted_setup& setup);
 };
 
 class commit {
@@ -179,15 +431,156 @@ public:
   static proof deserialize(const std::vector<uint8_t>& bytes);
 };
 
+/**
+* @brief Commitment to data larger than the trusted setup
+*
+* The data is split into shards of setup-sized polynomials that are committed
+* separately. The root hashes the layout together with a Merkle tree over the
+* shard commitments. It is the value to publish, and the only one a verifier
+* has to trust: proofs carry their shard's commitment and its path to the root.
+*/
+class sharded_commit {
+private:
+  std::vector<commit> shards;
+  std::vector<uint8_t> root;
+  uint64_t byte_length;
+  int chunk_size;
+  int shard_chunks;
+
+public:
+  sharded_commit(std::vector<commit> _shards, std::vector<uint8_t> _root, uint64_t _byte_length, int _chunk_size, int _shard_chunks) :
+    shards(_shards), root(_root), byte_length(_byte_length), chunk_size(_chunk_size), shard_chunks(_shard_chunks) {}
+  std::vector<commit>& get_shards() { return shards; }
+  const std::vector<uint8_t>& get_root() const { return root; }
+  uint64_t get_byte_length() const { return byte_length; }
+  int get_chunk_size() const { return chunk_size; }
+  int get_shard_chunks() const { return shard_chunks; }
+  
+  /**
+  * @brief Index of the shard holding a byte of the committed data
+  */
+  int shard_of(uint64_t byte_offset) const { return byte_offset / ((uint64_t) shard_chunks * chunk_size); }
+  
+  /**
+  * @brief Offset in the committed data of the first byte of a shard
+  * 
+  * Blobs for verify_sharded_proof use byte offsets relative to this.
+  */
+  uint64_t shard_byte_offset(int shard) const { return (uint64_t) shard * shard_chunks * chunk_size; }
+};
+
+/**
+* @brief Proof for a byte range of sharded data
+*
+* Carries everything needed to check it against a published root: the layout
+* of the data, the commitment of the shard holding the range and the sibling
+* hashes from that shard's leaf up to the Merkle root, leaf level first.
+*/
+class sharded_proof {
+private:
+  int shard;
+  commit shard_commit;
+  std::vector<std::vector<uint8_t>> path;
+  uint64_t byte_length;
+  int chunk_size;
+  int shard_chunks;
+  proof shard_proof;
+
+public:
+  sharded_proof(int _shard, commit _shard_commit, std::vector<std::vector<uint8_t>> _path, uint64_t _byte_length, int _chunk_size, int _shard_chunks, proof _shard_proof) :
+    shard(_shard), shard_commit(_shard_commit), path(_path), byte_length(_byte_length), chunk_size(_chunk_size), shard_chunks(_shard_chunks), shard_proof(_shard_proof) {}
+  int get_shard() const { return shard; }
+  commit& get_shard_commit() { return shard_commit; }
+  const std::vector<std::vector<uint8_t>>& get_path() const { return path; }
+  uint64_t get_byte_length() const { return byte_length; }
+  int get_chunk_size() const { return chunk_size; }
+  int get_shard_chunks() const { return shard_chunks; }
+  proof& get_proof() { return shard_proof; }
+};
+
+/**
+* @brief Point of G1 in affine coordinates (z = 1 is implied)
+*/
+struct G1_affine {
+  FP x, y;
+};
+
+/**
+* @brief Point of G2 in affine coordinates (z = 1 is implied)
+*/
+struct G2_affine {
+  FP2 x, y;
+};
+
+/**
+* @brief Contiguous, cache-line aligned array of setup points
+*
+* Setup points are stored in affine form, a third smaller than MIRACL's
+* projective points, and are read directly by the multi-scalar
+* multiplication. Copies of a table share its points, which are not modified
+* once the setup is built.
+*/
+template <typename T>
+class point_table {
+public:
+  point_table() : _size(0) {}
+  point_table(std::shared_ptr<T> data, size_t size) : _data(data), _size(size) {}
+  
+  void allocate(size_t n) {
+    size_t bytes = ((n * sizeof(T) + 63) / 64) * 64;
+    void* data = aligned_alloc(64, bytes > 0 ? bytes : 64);
+    if (data == NULL)
+      throw std::bad_alloc();
+    _data = std::shared_ptr<T>(static_cast<T*>(data), free);
+    _size = n;
+  }
+  
+  size_t size() const { return _size; }
+  T* data() { return _data.get(); }
+  const T* data() const { return _data.get(); }
+  T& operator[](size_t i) { return _data.get()[i]; }
+  const T& operator[](size_t i) const { return _data.get()[i]; }
+
+private:
+  std::shared_ptr<T> _data;
+  size_t _size;
+};
+
+/**
+* @brief Placement of a trusted setup published to shared memory
+*/
+struct shared_setup_options {
+  /** Directory of a hugetlbfs mount backing the segment with huge pages, empty for POSIX shared memory */
+  std::string hugepage_dir;
+  /** NUMA node the pages are bound to, -1 to leave placement to the kernel */
+  int numa_node = -1;
+  /** Interleave the pages over all allowed NUMA nodes (when numa_node is -1) */
+  bool numa_interleave = false;
+};
+
+class verify_cache;
+
 class trusted_setup {
+  friend class profile;
+
 private:
-  std::vector<ECP> _G1;
-  std::vector<ECP2> _G2;
+  point_table<G1_affine> _G1;
+  point_table<G2_affine> _G2;
+  std::shared_ptr<verify_cache> _verify_cache;
+  
+  // copies of _G1 shifted by multiples of _G1_stride bits, see precompute_G1
+  point_table<G1_affine> _G1_shifted;
+  int _G1_stride = 0;
   
   ECP polyeval_G1(const ZZ_pX& P);
+  ECP polyeval_G1(const ZZ_pX& P, workspace::state& ws);
   ECP2 polyeval_G2(const ZZ_pX& P);
+  ECP2 polyeval_G2(const ZZ_pX& P, workspace::state& ws);
+  bool verify_terms(ECP& D, ECP2& Z_G2, commit& commit, blob& expected_data, workspace::state& ws);
 
   void generate_elements_range(int start, int end, const std::vector<BIG>& s_powers);
+  
+  trusted_setup(point_table<G1_affine> G1, point_table<G2_affine> G2);
 
 public:
   /**
@@ -202,6 +595,26 @@ public:
   */
   trusted_setup(int num_coeff);
   
+  /**
+  * @brief Generates a trusted setup directly into a file
+  * 
+  * Worker threads compute the group elements in blocks and write each block
+  * at its place in the file, so memory use does not grow with num_coeff.
+  * Progress is checkpointed periodically, calling this again with the same
+  * checkpoint resumes an interrupted generation. The checkpoint contains the
+  * secret s: it is created readable by its owner only, and is overwritten and
+  * removed once the setup is complete.
+  * 
+  * The file has the format of kzg::trusted_setup::export_setup.
+  * 
+  * @param filename Path of the trusted setup file
+  * @param num_coeff The number of group elements to generate (num_coeff > 1)
+  * @param checkpoint_filename Path of the checkpoint (default: filename + ".checkpoint")
+  * @throws invalid_argument if num_coeff < 2 or the checkpoint is for a different num_coeff
+  * @throws runtime_error if the setup or checkpoint file cannot be written
+  */
+  static void generate_setup_file(const std::string& filename, int num_coeff, const std::string& checkpoint_filename = "");
+  
   /**
   * @brief Loads a trusted setup from a file exported with kzg::trusted_setup::export_setup
   * 
@@ -222,6 +635,19 @@ public:
   */
   commit create_commit(const kzg::poly& poly);
   
+  /**
+  * @brief Creates KZG commitments for many polynomials at once
+  * 
+  * Gives the same commitments as calling create_commit on each polynomial,
+  * but polynomials are split across threads and committed to in batches
+  * that share each pass over the setup, which pays off for many small ones.
+  * 
+  * @param polys The polynomials to commit to (each of degree at most one less than the setup size)
+  * @return The commitments, in the order of polys
+  * @throws invalid_argument if a polynomial's degree is too large
+  */
+  std::vector<commit> create_commits(const std::vector<kzg::poly>& polys);
+  
   /**
   * @brief Verifies that a commitment matches a given polynomial
   * 
@@ -264,11 +690,39 @@ public:
   */
   proof create_proof(const kzg::poly& poly, int chunk_offset, int chunk_length);
   
+  /**
+  * @brief Creates a KZG proof for a specific chunk range using a workspace
+  * 
+  * @param poly The polynomial to create a proof for
+  * @param chunk_offset Starting chunk position
+  * @param chunk_length Number of chunks to prove
+  * @param workspace Scratch memory reused across calls
+  * @return A KZG proof object
+  * @throws invalid_argument if chunk_length < 1
+  */
+  proof create_proof(const kzg::poly& poly, int chunk_offset, int chunk_length, workspace& workspace);
+  
+  /**
+  * @brief Creates a single KZG proof for an arbitrary set of chunk positions
+  * 
+  * The chunks do not have to be contiguous. Verify the proof with verify_proof
+  * and a blob holding the same positions, e.g. from blob::from_bytes with
+  * chunk indices.
+  * 
+  * @param poly The polynomial to create a proof for
+  * @param chunk_indices Distinct, non-negative chunk positions
+  * @return A KZG proof object
+  * @throws invalid_argument if chunk_indices is empty or has negative or repeated entries
+  */
+  proof create_proof(const kzg::poly& poly, const std::vector<int>& chunk_indices);
+  
   /**
   * @brief Verifies a KZG proof against a commitment and expected data
   * 
   * Verifies that the proof correctly demonstrates that the committed polynomial
-  * evaluates to the expected values at the specified points.
+  * evaluates to the expected values at the specified points. For windows of
+  * consecutive points, the vanishing polynomial and its G2 evaluation are
+  * cached, and interpolation weights are shared between windows of equal length.
   * 
   * @param commit The commitment to verify against
   * @param proof The proof to verify
@@ -278,6 +732,172 @@ public:
   */
   bool verify_proof(commit& commit, proof& proof, blob& expected_data);
   
+  /**
+  * @brief Verifies a KZG proof against a commitment and expected data using a workspace
+  * 
+  * @param commit The commitment to verify against
+  * @param proof The proof to verify
+  * @param expected_data The blob containing expected evaluation points and values
+  * @param workspace Scratch memory reused across calls
+  * @return true if the proof is valid, false otherwise
+  * @throws invalid_argument if expected_data is empty
+  */
+  bool verify_proof(commit& commit, proof& proof, blob& expected_data, workspace& workspace);
+  
+  /**
+  * @brief Verifies many proofs at once
+  * 
+  * The records are prepared in parallel and checked together with a single
+  * multi-pairing, in which proofs over the same window share one pairing.
+  * If the batch check fails, each record is checked on its own to find the
+  * invalid ones.
+  * 
+  * @param commits The commitment of each record
+  * @param proofs The proof of each record
+  * @param expected_data The data each proof is expected to open to
+  * @return Whether each proof is valid, in the order of the records
+  * @throws invalid_argument if the sizes differ or some expected_data is empty
+  */
+  std::vector<bool> verify_proofs(std::vector<commit>& commits, std::vector<proof>& proofs, std::vector<blob>& expected_data);
+  
+  /**
+  * @brief Opens a polynomial at an arbitrary field element
+  * 
+  * Computes y = P(z) and a proof that the committed polynomial evaluates to
+  * y at z. Unlike create_proof, z does not have to be a chunk position.
+  * 
+  * @param poly The polynomial to open
+  * @param z The evaluation point
+  * @return The evaluation y and the proof
+  */
+  std::pair<ZZ_p, proof> create_opening(const kzg::poly& poly, const ZZ_p& z);
+  
+  /**
+  * @brief Verifies an opening created with kzg::trusted_setup::create_opening
+  * 
+  * Checks e(proof, [s]₂) = e(commit - [y]₁ + z * proof, [1]₂), which only
+  * uses the first two G2 elements of the setup and costs one pairing
+  * regardless of the polynomial degree.
+  * 
+  * @param commit The commitment to verify against
+  * @param proof The opening proof
+  * @param z The evaluation point
+  * @param y The claimed value at z
+  * @return true if the proof is valid, false otherwise
+  */
+  bool verify_opening(commit& commit, proof& proof, const ZZ_p& z, const ZZ_p& y);
+  
+  /**
+  * @brief Opens several polynomials at the same point with a single proof
+  * 
+  * The polynomials are combined as sum γ^i P_i, where γ is a Fiat–Shamir
+  * challenge derived from the commitments, z and the evaluations, and the
+  * combination is opened at z.
+  * 
+  * @param polys The polynomials to open
+  * @param commits The commitments to the polynomials, in the same order
+  * @param z The evaluation point
+  * @return The evaluations P_i(z) and the proof
+  * @throws invalid_argument if the vectors are empty or of different sizes
+  */
+  std::pair<std::vector<ZZ_p>, proof> create_batch_opening(const std::vector<kzg::poly>& polys, std::vector<commit>& commits, const ZZ_p& z);
+  
+  /**
+  * @brief Verifies an opening created with kzg::trusted_setup::create_batch_opening
+  * 
+  * Recomputes the challenge, combines the commitments with one multi-scalar
+  * multiplication and checks the combination with a single pairing equation.
+  * 
+  * @param commits The commitments to the polynomials
+  * @param proof The batch proof
+  * @param z The evaluation point
+  * @param ys The claimed evaluations, in the same order as commits
+  * @return true if the proof is valid for every polynomial, false otherwise
+  * @throws invalid_argument if the vectors are empty or of different sizes
+  */
+  bool verify_batch_opening(std::vector<commit>& commits, proof& proof, const ZZ_p& z, const std::vector<ZZ_p>& ys);
+  
+  /**
+  * @brief Publishes the decoded setup to a named shared memory segment
+  * 
+  * Other processes attach to the segment with attach_shared instead of each
+  * loading a private copy. The segment outlives this process until it is
+  * removed with unlink_shared.
+  * 
+  * @param name Name of the segment (without '/')
+  * @param options Huge page backing and NUMA placement of the segment
+  * @return The digest of the published points, to be passed to attach_shared
+  * @throws runtime_error if the segment exists already or cannot be created
+  * @throws invalid_argument for a bad name or NUMA node
+  */
+  std::vector<uint8_t> publish_shared(const std::string& name, const shared_setup_options& options = shared_setup_options()) const;
+  
+  /**
+  * @brief Attaches read-only to a setup published with publish_shared, without copying it
+  * 
+  * Anyone able to create the segment first could plant a setup of their own,
+  * so the segment must be owned by this user and not writable by anyone else,
+  * and its points must hash to expected_digest.
+  * 
+  * @param name Name of the segment
+  * @param expected_digest The digest of the setup (see digest), from a trusted source
+  * @param options Only hugepage_dir is used, to locate the segment
+  * @throws runtime_error if the segment does not exist, is not complete yet,
+  * was published by a build for another curve, by another user or is writable
+  * by other users, or its points do not match expected_digest
+  */
+  static trusted_setup attach_shared(const std::string& name, const std::vector<uint8_t>& expected_digest, const shared_setup_options& options = shared_setup_options());
+  
+  /**
+  * @brief SHA-256 of the setup points in their canonical big-endian encoding
+  * 
+  * Identifies a setup independently of how it was loaded, e.g. to check a
+  * shared segment against the setup file it was published from.
+  * 
+  * @return The 32 byte digest
+  */
+  std::vector<uint8_t> digest() const;
+  
+  /**
+  * @brief Removes a segment created by publish_shared, attached setups stay valid
+  */
+  static void unlink_shared(const std::string& name, const shared_setup_options& options = shared_setup_options());
+  
+  /**
+  * @brief Precomputes shifted copies of the G1 elements for faster commitments and proofs
+  * 
+  * Each element is stored with its multiples by 2^stride, 2^(2 stride) and
+  * so on, and commitments and proofs then use a fixed-base MSM that only
+  * doubles through stride bits of the scalars. Memory for G1 grows about
+  * (scalar bits / stride) times, a smaller stride is faster. Copies of the
+  * setup made afterwards share the table.
+  * 
+  * @param stride Scalar bits between consecutive copies (at least 2)
+  * @throws invalid_argument if stride is out of range
+  */
+  void precompute_G1(int stride = 64);
+  
+  /**
+  * @brief Saves the table built by precompute_G1, to be loaded with load_precomputed
+  * 
+  * @param filename Path of the table, e.g. next to the setup file
+  * @throws runtime_error if nothing was precomputed or the file cannot be written
+  */
+  void save_precomputed(const std::string& filename) const;
+  
+  /**
+  * @brief Loads a table saved by save_precomputed instead of computing it again
+  * 
+  * The file is host independent and is decoded into memory. It is trusted like the setup itself. A digest of the whole table
+  * and its unshifted copies are checked, which catches a damaged file or one
+  * for another setup, but not one rewritten together with its digest.
+  * 
+  * @param filename Path of the table
+  * @throws runtime_error if the file is missing, damaged, or was made for
+  * another setup or build
+  */
+  void load_precomputed(const std::string& filename);
+  
   /**
   * @brief Exports the trusted setup to a binary file
   * 
@@ -287,8 +907,185 @@ public:
   * @param filename Path where the trusted setup should be exported (default: "kzg_public")
   */
   void export_setup(const std::string& filename = "kzg_public");
+  
+  /**
+  * @brief Commits to data of any size by splitting it into shards
+  * 
+  * Each shard holds as many chunks as a polynomial of this setup can, shards
+  * are committed in parallel and only one shard's polynomial is held per
+  * worker thread at a time.
+  * 
+  * @param bytes The data to commit to
+  * @param byte_length Length of the data (must be a multiple of chunk_size)
+  * @param chunk_size The number of bytes that each point represents (must be at most MAX_CHUNK_BYTES)
+  * @return The shard commitments and their root
+  * @throws invalid_argument if parameters don't meet the required constraints
+  */
+  sharded_commit create_sharded_commit(const uint8_t* bytes, uint64_t byte_length, int chunk_size);
+  
+  /**
+  * @brief Creates a proof for a byte range of sharded data
+  * 
+  * Only the polynomial of the shard holding the range is rebuilt.
+  * 
+  * @param commit The sharded commitment of the data
+  * @param bytes The full committed data
+  * @param byte_offset Offset of the range in the data (must be a multiple of chunk_size)
+  * @param byte_length Length of the range (must be a multiple of chunk_size)
+  * @return The proof, carrying its shard's index, commitment and path to the root
+  * @throws invalid_argument if the range is misaligned, out of bounds or crosses a shard boundary
+  */
+  sharded_proof create_sharded_proof(sharded_commit& commit, const uint8_t* bytes, uint64_t byte_offset, int byte_length);
+  
+  /**
+  * @brief Verifies a proof for a byte range of sharded data
+  * 
+  * The shard commitment and layout the proof carries are hashed up its path
+  * and must give root, so nothing but the root has to come from the committer.
+  * 
+  * @param root The published root of the sharded commitment (sharded_commit::get_root)
+  * @param proof The proof to verify
+  * @param expected_data The expected data, positioned relative to the start of the proof's shard
+  * @return true if the proof is valid, false otherwise
+  */
+  bool verify_sharded_proof(const std::vector<uint8_t>& root, sharded_proof& proof, blob& expected_data);
+  
+  /**
+  * @brief Creates the proofs of every cell of data extended by blob::extend
+  * 
+  * Cell i covers the cell_size points from x = i cell_size, its proof
+  * verifies against the data's commitment like any window proof. The cell
+  * quotients are computed in parallel and then committed to together with
+  * create_commits.
+  * 
+  * @param poly The polynomial of the data
+  * @param num_chunks The number of points of the data before the extension
+  * @param cell_size The number of points per cell, dividing 2 num_chunks
+  * @return The proof of each cell
+  * @throws invalid_argument if cell_size does not divide the extension or
+  * the data does not fit the setup
+  */
+  std::vector<proof> create_cell_proofs(const poly& poly, int num_chunks, int cell_size);
 };
 
+#ifdef KZG_CURVE_BLS12381
+/**
+* @brief KZG commitments to Ethereum blobs as specified by EIP-4844
+*
+* A blob is 4096 field elements of 32 big-endian bytes, the evaluations of a
+* polynomial over the roots of unity of order 4096 in bit-reversed order.
+* Commitments and proofs are 48-byte compressed G1 points. Results match
+* those of the consensus specs and c-kzg, so the published trusted setup can
+* be loaded directly.
+*
+* Only available when the library is built for BLS12-381. kzg::init() must be
+* called before loading a setup. Malformed inputs (wrong lengths, field
+* elements not below the curve order, bytes that are not a compressed point
+* of the subgroup) throw invalid_argument.
+*/
+class eip4844 {
+public:
+  static const int FIELD_ELEMENTS_PER_BLOB = 4096;
+  static const int BYTES_PER_FIELD_ELEMENT = 32;
+  static const int BYTES_PER_BLOB = FIELD_ELEMENTS_PER_BLOB * BYTES_PER_FIELD_ELEMENT;
+  static const int BYTES_PER_COMMITMENT = 48;
+  static const int BYTES_PER_PROOF = 48;
+  
+  struct domain;
+  
+  /**
+  * @brief Loads the trusted setup in the text format of c-kzg (trusted_setup.txt)
+  * 
+  * The file holds the number of G1 and G2 points, the compressed G1 points in
+  * Lagrange form and the compressed G2 points in monomial form, one hex
+  * encoded point per line. Trailing G1 monomial points are ignored.
+  * 
+  * @param filename Path of the trusted setup
+  * @throws runtime_error if the file cannot be read or is malformed
+  */
+  eip4844(const std::string& filename);
+  
+  /**
+  * @brief Writes a trusted setup for a random secret in the format read by the constructor
+  * 
+  * The secret is discarded, but this is no substitute for a ceremony. Meant
+  * for tests and private networks.
+  * 
+  * @param filename Path of the trusted setup
+  */
+  static void generate_setup_file(const std::string& filename);
+  
+  /**
+  * @brief Computes the commitment to a blob
+  * 
+  * @param blob BYTES_PER_BLOB bytes
+  * @return The compressed commitment
+  */
+  std::vector<uint8_t> blob_to_commitment(const std::vector<uint8_t>& blob);
+  
+  /**
+  * @brief Computes the proof of the blob polynomial's value at z
+  * 
+  * @param blob BYTES_PER_BLOB bytes
+  * @param z The point, a 32-byte field element
+  * @return The compressed proof and the value y, a 32-byte field element
+  */
+  std::pair<std::vector<uint8_t>, std::vector<uint8_t>> compute_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& z);
+  
+  /**
+  * @brief Computes the Fiat-Shamir challenge of a blob and its commitment
+  * 
+  * The point at which blob proofs open the blob polynomial, the SHA-256 of the
+  * domain separator, the blob and the commitment reduced modulo the curve order.
+  * 
+  * @param blob BYTES_PER_BLOB bytes
+  * @param commitment The blob's compressed commitment
+  * @return The challenge, a 32-byte field element
+  * @throws invalid_argument if the blob or the commitment is of the wrong size
+  */
+  std::vector<uint8_t> compute_challenge(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment);
+  
+  /**
+  * @brief Computes the proof for a blob at its Fiat-Shamir challenge
+  * 
+  * @param blob BYTES_PER_BLOB bytes
+  * @param commitment The blob's compressed commitment
+  * @return The compressed proof
+  */
+  std::vector<uint8_t> compute_blob_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment);
+  
+  /**
+  * @brief Verifies that the committed polynomial takes the value y at z
+  * 
+  * @return true if the proof is valid, false otherwise
+  */
+  bool verify_proof(const std::vector<uint8_t>& commitment, const std::vector<uint8_t>& z, const std::vector<uint8_t>& y, const std::vector<uint8_t>& proof);
+  
+  /**
+  * @brief Verifies a proof created by compute_blob_proof
+  * 
+  * @return true if the proof is valid, false otherwise
+  */
+  bool verify_blob_proof(const std::vector<uint8_t>& blob, const std::vector<uint8_t>& commitment, const std::vector<uint8_t>& proof);
+  
+  /**
+  * @brief Verifies several blob proofs at once
+  * 
+  * The proofs are combined with powers of a random challenge, so a single
+  * pairing check covers the whole batch.
+  * 
+  * @return true if every proof is valid (or the batch is empty), false otherwise
+  * @throws invalid_argument if the vectors are of different sizes
+  */
+  bool verify_blob_proof_batch(const std::vector<std::vector<uint8_t>>& blobs, const std::vector<std::vector<uint8_t>>& commitments, const std::vector<std::vector<uint8_t>>& proofs);
+
+private:
+  point_table<G1_affine> _G1_lagrange;
+  std::vector<ECP2> _G2_monomial;
+  std::shared_ptr<const domain> _domain;
+};
+#endif
+
 }
 
 #endif
@@ -0,0 +1,56 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+// Fixed capacity map that evicts the least recently used entry. Safe to share
+// between threads, values are copied out so they should be cheap to copy.
+template <typename K, typename V>
+class lru_cache {
+private:
+  typedef std::list<std::pair<K, V>> entry_list;
+  
+  size_t capacity;
+  entry_list entries;  // most recently used first
+  std::map<K, typename entry_list::iterator> index;
+  std::mutex mutex;
+
+public:
+  explicit lru_cache(size_t _capacity) : capacity(_capacity) {}
+  
+  bool get(const K& key, V& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end())
+      return false;
+    
+    entries.splice(entries.begin(), entries, it->second);
+    value = it->second->second;
+    return true;
+  }
+  
+  void put(const K& key, const V& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity == 0)
+      return;
+    
+    auto it = index.find(key);
+    if (it != index.end()) {
+      it->second->second = value;
+      entries.splice(entries.begin(), entries, it->second);
+      return;
+    }
+    
+    entries.push_front({ key, value });
+    index[key] = entries.begin();
+    if (entries.size() > capacity) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef MSM_H
+#define MSM_H
+
+#include <kzg.h>
+
+// Everything here runs in variable time and is only for public scalars,
+// anything derived from the setup secret goes through PAIR_G1mul / PAIR_G2mul
+int msm_window_size(int n);
+void mul_vartime_G1(ECP& P, BIG e);
+void mul_vartime_G2(ECP2& P, BIG e);
+void msm_G1(ECP& res, const ECP* bases, BIG* scalars, int n);
+void msm_G1(ECP& res, const kzg::G1_affine* bases, BIG* scalars, int n);
+// table holds copies entries per base, entry k being 2^(k stride) times the base
+void fixed_base_msm_G1(ECP& res, const kzg::G1_affine* table, int copies, int stride, BIG* scalars, int n);
+// res[j] = sum of scalars[j][i] bases[i] for i < lengths[j]
+void msm_G1_batch(ECP* res, const kzg::G1_affine* bases, BIG* const* scalars, const int* lengths, int m);
+void msm_G2(ECP2& res, const ECP2* bases, BIG* scalars, int n);
+void msm_G2(ECP2& res, const kzg::G2_affine* bases, BIG* scalars, int n);
+
+// Batch conversion of projective points to affine with a single inversion
+void normalize_G1(kzg::G1_affine* res, ECP* points, size_t n);
+void normalize_G2(kzg::G2_affine* res, ECP2* points, size_t n);
+void ECP_from_affine(ECP& P, const kzg::G1_affine& A);
+void ECP2_from_affine(ECP2& P, const kzg::G2_affine& A);
+
+#endif
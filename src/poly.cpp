@@ -5,6 +5,12 @@ kzg::poly kzg::poly::from_blob(kzg::blob blob) {
   return kzg::poly(polyfit(blob.get_data()));
 }
 
+kzg::poly kzg::poly::from_blob(kzg::blob& blob, kzg::workspace& workspace) {
+  ZZ_pX data;
+  polyfit(data, blob.get_data(), workspace.get_state());
+  return kzg::poly(data);
+}
+
 std::vector<uint8_t> kzg::poly::serialize() {
   return serialize_ZZ_pX(data);
 }
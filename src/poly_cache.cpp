@@ -0,0 +1,168 @@
+#include <kzg.h>
+#include "util.h"
+#include "field.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache of a committed polynomial: a header keyed by the commitment, then the
+// coefficients as FR_LIMBS 64-bit limbs each, least significant first. Every
+// integer in the file is written byte by byte in little-endian order, so the
+// file does not depend on the host, and can be mapped and converted without
+// parsing.
+
+static const char CACHE_MAGIC[8] = { 'K', 'Z', 'G', 'P', 'O', 'L', 'Y', '1' };
+static constexpr size_t COMMIT_SIZE = sizeof(uint32_t) + 2 * MODBYTES_CURVE + 1;
+static constexpr size_t COEFF_SIZE = FR_LIMBS * sizeof(uint64_t);
+
+struct cache_header {
+  char magic[8];
+  uint8_t limbs[4];
+  uint8_t commit_size[4];
+  uint8_t num_coeff[8];
+  char modulus[MODBYTES_CURVE];
+  uint8_t commit[COMMIT_SIZE];
+  char digest[32];
+};
+
+static constexpr size_t DATA_OFFSET = ((sizeof(cache_header) + 63) / 64) * 64;
+
+static void store_le(uint8_t* bytes, uint64_t value, int width) {
+  for (int i = 0; i < width; i++)
+    bytes[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t load_le(const uint8_t* bytes, int width) {
+  uint64_t value = 0;
+  for (int i = 0; i < width; i++)
+    value |= (uint64_t) bytes[i] << (8 * i);
+  return value;
+}
+
+static void commit_key(uint8_t* key, kzg::commit& commit) {
+  std::vector<uint8_t> bytes = commit.serialize();
+  memset(key, 0, COMMIT_SIZE);
+  memcpy(key, bytes.data(), std::min(bytes.size(), COMMIT_SIZE));
+}
+
+// The commitment is recomputed rather than trusted, a cache filed under the
+// wrong commitment would be served as that commitment's polynomial later
+void kzg::poly::save_cache(const std::string& filename, kzg::commit& commit, kzg::trusted_setup& setup) const {
+  if (!setup.verify_commit(commit, *this))
+    throw invalid_argument("commit is not the commitment to this polynomial");
+  
+  long n = deg(data) + 1;
+  std::vector<uint8_t> coeffs(n * COEFF_SIZE);
+  parallel_ranges(n, [&](uint64_t begin, uint64_t end) {
+    uint64_t limbs[FR_LIMBS];
+    for (uint64_t i = begin; i < end; i++) {
+      limbs_from_ZZ(limbs, rep(data[i]));
+      for (int j = 0; j < FR_LIMBS; j++)
+        store_le(&coeffs[i * COEFF_SIZE + j * sizeof(uint64_t)], limbs[j], sizeof(uint64_t));
+    }
+  });
+
+  cache_header header = {};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  store_le(header.limbs, FR_LIMBS, sizeof(header.limbs));
+  store_le(header.commit_size, COMMIT_SIZE, sizeof(header.commit_size));
+  store_le(header.num_coeff, n, sizeof(header.num_coeff));
+  curve_modulus(header.modulus);
+  commit_key(header.commit, commit);
+  block_sha256(header.digest, coeffs.data(), coeffs.size());
+
+  // written aside and renamed, so a reader never maps a partial cache
+  std::string tmp_filename = filename + ".tmp";
+  std::ofstream file(tmp_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw runtime_error("could not write polynomial cache");
+
+  std::vector<char> padding(DATA_OFFSET - sizeof(cache_header), 0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(padding.data(), padding.size());
+  file.write(reinterpret_cast<const char*>(coeffs.data()), coeffs.size());
+  file.close();
+  if (!file || std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    throw runtime_error("could not write polynomial cache");
+  }
+}
+
+kzg::poly kzg::poly::load_cache(const std::string& filename, kzg::commit& commit, kzg::trusted_setup& setup) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("could not open polynomial cache");
+
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t) DATA_OFFSET)
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw runtime_error("bad polynomial cache");
+
+  size_t length = st.st_size;
+  std::shared_ptr<void> mapping(addr, [length](void* p) { munmap(p, length); });
+  const cache_header* header = static_cast<const cache_header*>(addr);
+  const uint8_t* coeffs = static_cast<const uint8_t*>(addr) + DATA_OFFSET;
+  uint64_t num_coeff = load_le(header->num_coeff, sizeof(header->num_coeff));
+
+  char modulus[MODBYTES_CURVE];
+  curve_modulus(modulus);
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+      || load_le(header->limbs, sizeof(header->limbs)) != FR_LIMBS
+      || load_le(header->commit_size, sizeof(header->commit_size)) != COMMIT_SIZE
+      || memcmp(header->modulus, modulus, sizeof(modulus)) != 0
+      || num_coeff > (st.st_size - DATA_OFFSET) / COEFF_SIZE)
+    throw runtime_error("bad polynomial cache");
+
+  uint8_t key[COMMIT_SIZE];
+  commit_key(key, commit);
+  if (memcmp(header->commit, key, COMMIT_SIZE) != 0)
+    throw runtime_error("polynomial cache is for another commitment");
+
+  char digest[32];
+  block_sha256(digest, coeffs, num_coeff * COEFF_SIZE);
+  if (memcmp(header->digest, digest, sizeof(digest)) != 0)
+    throw runtime_error("polynomial cache is corrupt");
+
+  long n = num_coeff;
+  ZZ_pX P;
+  P.SetLength(n);
+
+  ZZ_pContext context;
+  context.save();
+  std::atomic<bool> valid(true);
+  parallel_ranges(n, [&](uint64_t begin, uint64_t end) {
+    context.restore();
+    uint64_t limbs[FR_LIMBS];
+    ZZ value;
+    for (uint64_t i = begin; i < end; i++) {
+      for (int j = 0; j < FR_LIMBS; j++)
+        limbs[j] = load_le(coeffs + i * COEFF_SIZE + j * sizeof(uint64_t), sizeof(uint64_t));
+      if (fr_geq_modulus(limbs))
+        valid = false;
+      ZZ_from_limbs(value, limbs);
+      conv(P[i], value);
+    }
+  });
+  if (!valid)
+    throw runtime_error("polynomial cache is corrupt");
+
+  // the key and the digest sit in the same file as the data, only the
+  // commitment itself ties the coefficients to it
+  P.normalize();
+  kzg::poly res(P);
+  bool matches = false;
+  try { matches = setup.verify_commit(commit, res); }
+  catch (const invalid_argument& e) {}
+  if (!matches)
+    throw runtime_error("polynomial cache does not match its commitment");
+  return res;
+}
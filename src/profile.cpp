@@ -0,0 +1,294 @@
+#include <kzg.h>
+#include "util.h"
+#include "msm.h"
+
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+kzg::profile kzg::PROFILE;
+
+unsigned int kzg::profile::thread_count() const {
+  if (num_threads > 0)
+    return num_threads;
+
+  unsigned int hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads == 0 ? 4 : hardware_threads;
+}
+
+// MSM windows are clamped to 16 bits, larger offsets all give the smallest window
+static const long MAX_WINDOW_OFFSET = 16;
+static const long MAX_PROFILE_THREADS = 4096;
+
+static int profile_value(const std::string& key, long value, long min, long max) {
+  if (value < min || value > max)
+    throw runtime_error("bad profile value for " + key);
+  return value;
+}
+
+kzg::profile kzg::profile::load(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open())
+    throw runtime_error("could not open profile file");
+
+  kzg::profile res;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    std::string key;
+    long value;
+    if (!(fields >> key >> value))
+      throw runtime_error("bad profile file");
+
+    if (key == "modbytes" && value != MODBYTES_CURVE)
+      throw runtime_error("profile was calibrated for a different curve");
+    else if (key == "fast_multieval_threshold")
+      res.fast_multieval_threshold = profile_value(key, value, 0, INT_MAX);
+    else if (key == "reciprocal_div_threshold")
+      res.reciprocal_div_threshold = profile_value(key, value, 0, INT_MAX);
+    else if (key == "ntt_div_threshold")
+      res.ntt_div_threshold = profile_value(key, value, 0, INT_MAX);
+    else if (key == "msm_g1_threshold")
+      res.msm_g1_threshold = profile_value(key, value, 0, INT_MAX);
+    else if (key == "msm_g2_threshold")
+      res.msm_g2_threshold = profile_value(key, value, 0, INT_MAX);
+    else if (key == "msm_window_offset")
+      res.msm_window_offset = profile_value(key, value, 0, MAX_WINDOW_OFFSET);
+    else if (key == "num_threads")
+      res.num_threads = profile_value(key, value, 1, MAX_PROFILE_THREADS);
+    else if (key == "parallel_grain")
+      res.parallel_grain = profile_value(key, value, 1, INT_MAX);
+    else if (key == "verify_cache_size")
+      res.verify_cache_size = profile_value(key, value, 0, INT_MAX);
+  }
+
+  return res;
+}
+
+void kzg::profile::save(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::out | std::ios::trunc);
+  if (!file.is_open())
+    throw runtime_error("could not write profile file");
+
+  file << "# kzg-commitments calibration profile" << endl;
+  file << "modbytes " << MODBYTES_CURVE << endl;
+  file << "fast_multieval_threshold " << fast_multieval_threshold << endl;
+  file << "reciprocal_div_threshold " << reciprocal_div_threshold << endl;
+  file << "ntt_div_threshold " << ntt_div_threshold << endl;
+  file << "msm_g1_threshold " << msm_g1_threshold << endl;
+  file << "msm_g2_threshold " << msm_g2_threshold << endl;
+  file << "msm_window_offset " << msm_window_offset << endl;
+  // 0 threads means the hardware concurrency of whichever machine loads it
+  if (num_threads > 0)
+    file << "num_threads " << num_threads << endl;
+  file << "parallel_grain " << parallel_grain << endl;
+  file << "verify_cache_size " << verify_cache_size << endl;
+}
+
+// Best of a few runs, in milliseconds
+static double time_ms(const std::function<void()>& f, int runs = 3) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+// Smallest size at which the fast variant won, or INT_MAX if it never did.
+// Sizes are tried in increasing order and a single win after the slow
+// variant was ahead is confirmed by the next size.
+static int crossover(const std::vector<int>& sizes, const std::function<bool(int)>& fast_wins) {
+  bool prev_won = false;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    bool won = fast_wins(sizes[i]);
+    if (prev_won && won)
+      return sizes[i - 1];
+    if (won && i + 1 == sizes.size())
+      return sizes[i];
+    prev_won = won;
+  }
+  return INT_MAX;
+}
+
+// The window offset that was fastest at the most sizes from the crossover
+// on, where the bucket method actually runs. Ties go to the larger sizes.
+static int window_offset(const std::map<int, int>& winners, int threshold, int fallback) {
+  std::map<int, int> votes;
+  for (auto& winner : winners) {
+    if (winner.first >= threshold)
+      votes[winner.second]++;
+  }
+  
+  int best = fallback, best_votes = 0;
+  for (auto& winner : winners) {
+    if (winner.first >= threshold && votes[winner.second] >= best_votes) {
+      best = winner.second;
+      best_votes = votes[winner.second];
+    }
+  }
+  return best;
+}
+
+kzg::profile kzg::profile::calibrate(bool verbose) {
+  const int num_coeff = 4097;
+  kzg::profile saved = kzg::PROFILE;
+  kzg::profile res;
+
+  // thread fan-out for trusted setup generation
+  double best_time = 0;
+  unsigned int max_threads = 2 * res.thread_count();
+  for (unsigned int t = 1; t <= max_threads; t *= 2) {
+    kzg::PROFILE.num_threads = t;
+    double elapsed = time_ms([]() { kzg::trusted_setup setup(1024); }, 1);
+    if (verbose)
+      cout << "threads " << t << ": setup " << elapsed << "ms" << endl;
+    if (t == 1 || elapsed < best_time) {
+      best_time = elapsed;
+      res.num_threads = t;
+    }
+  }
+  kzg::PROFILE = res;
+
+  kzg::trusted_setup setup(num_coeff);
+  ZZ_pX P;
+  random(P, num_coeff - 1);
+
+  // naive scalar multiplication vs. the bucket method, over window offsets
+  std::map<int, int> g1_offsets;
+  for (int group = 1; group <= 2; group++) {
+    std::vector<int> sizes = { 8, 16, 32, 64, 128, 256, 512 };
+    auto fast_wins = [&](int n) {
+      ZZ_pX Q = trunc(P, n);
+      std::vector<BIG> scalars(n);
+      for (int i = 0; i < n; i++)
+        BIG_from_ZZ(scalars[i], rep(coeff(Q, i)));
+
+      auto run = [&]() {
+        if (group == 1) {
+          ECP res_G1;
+          msm_G1(res_G1, setup._G1.data(), scalars.data(), n);
+        } else {
+          ECP2 res_G2;
+          msm_G2(res_G2, setup._G2.data(), scalars.data(), n);
+        }
+      };
+
+      kzg::PROFILE.msm_g1_threshold = kzg::PROFILE.msm_g2_threshold = INT_MAX;
+      double naive = time_ms(run);
+
+      double bucket = 0;
+      int best_offset = 0;
+      kzg::PROFILE.msm_g1_threshold = kzg::PROFILE.msm_g2_threshold = 0;
+      for (int offset = 0; offset <= 4; offset++) {
+        kzg::PROFILE.msm_window_offset = offset;
+        double elapsed = time_ms(run);
+        if (offset == 0 || elapsed < bucket) {
+          bucket = elapsed;
+          best_offset = offset;
+        }
+      }
+      kzg::PROFILE.msm_window_offset = res.msm_window_offset;
+      if (group == 1)
+        g1_offsets[n] = best_offset;
+
+      if (verbose)
+        cout << "G" << group << " msm " << n << ": naive " << naive << "ms, bucket " << bucket << "ms" << endl;
+      return bucket < naive;
+    };
+
+    int threshold = crossover(sizes, fast_wins);
+    if (group == 1)
+      res.msm_g1_threshold = threshold;
+    else
+      res.msm_g2_threshold = threshold;
+  }
+  res.msm_window_offset = window_offset(g1_offsets, res.msm_g1_threshold, res.msm_window_offset);
+  kzg::PROFILE = res;
+
+  // point-by-point evaluation vs. falling factorial evaluation of the consecutive window
+  {
+    std::vector<int> sizes = { 16, 32, 64, 96, 128, 192, 256, 384, 512, 1024 };
+    res.fast_multieval_threshold = crossover(sizes, [&](int n) {
+      vector<pair<ZZ_p, ZZ_p>> points;
+      kzg::PROFILE.fast_multieval_threshold = INT_MAX;
+      double naive = time_ms([&]() { points.clear(); evaluate_polynomial_points(points, P, 0, n); });
+      kzg::PROFILE.fast_multieval_threshold = 0;
+      double falling = time_ms([&]() { points.clear(); evaluate_polynomial_points(points, P, 0, n); });
+
+      if (verbose)
+        cout << "multieval " << n << ": naive " << naive << "ms, falling factorial " << falling << "ms" << endl;
+      return falling < naive;
+    });
+    kzg::PROFILE = res;
+  }
+
+  // plain division vs. Newton reciprocal vs. FFT modulus
+  {
+    std::vector<int> sizes = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048 };
+    auto time_division = [&](int n, int reciprocal, int ntt) {
+      ZZ_pX Z, q;
+      vanishing_poly(Z, 0, n);
+      kzg::PROFILE.reciprocal_div_threshold = reciprocal;
+      kzg::PROFILE.ntt_div_threshold = ntt;
+      return time_ms([&]() { quotient_vanishing(q, P, Z); });
+    };
+
+    res.reciprocal_div_threshold = crossover(sizes, [&](int n) {
+      double plain = time_division(n, INT_MAX, INT_MAX);
+      double newton = time_division(n, 0, INT_MAX);
+      if (verbose)
+        cout << "division " << n << ": plain " << plain << "ms, newton " << newton << "ms" << endl;
+      return newton < plain;
+    });
+
+    res.ntt_div_threshold = crossover(sizes, [&](int n) {
+      double newton = time_division(n, 0, INT_MAX);
+      double ntt = time_division(n, 0, 0);
+      if (verbose)
+        cout << "division " << n << ": newton " << newton << "ms, fft " << ntt << "ms" << endl;
+      return ntt < newton;
+    });
+
+    if (res.ntt_div_threshold < res.reciprocal_div_threshold)
+      res.reciprocal_div_threshold = res.ntt_div_threshold;
+  }
+
+  // smallest range worth handing to another thread
+  kzg::PROFILE = res;
+  {
+    vector<pair<ZZ_p, ZZ_p>> points;
+    for (int i = 0; i < num_coeff; i++) {
+      ZZ_p x;
+      x = i;
+      points.push_back({ x, random_ZZ_p() });
+    }
+    
+    double best = 0;
+    for (int grain : { 256, 512, 1024, 2048, INT_MAX }) {
+      kzg::PROFILE.parallel_grain = grain;
+      double elapsed = time_ms([&]() { polyfit(points); }, 1);
+      if (verbose)
+        cout << "polyfit grain " << grain << ": " << elapsed << "ms" << endl;
+      if (grain == 256 || elapsed < best) {
+        best = elapsed;
+        res.parallel_grain = grain;
+      }
+    }
+  }
+  
+  kzg::PROFILE = saved;
+  return res;
+}
@@ -0,0 +1,372 @@
+#include <kzg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "util.h"
+#include "field.h"
+#include "msm.h"
+
+static constexpr size_t G1_OCTET_SIZE = 2 * MODBYTES_CURVE + 1;
+static constexpr size_t G2_OCTET_SIZE = 4 * MODBYTES_CURVE + 1;
+
+// Every record of a setup file is a u32 length followed by an uncompressed
+// point, so all records of a group have the same size and known offsets
+static constexpr size_t HEADER_SIZE = sizeof(uint64_t);
+static constexpr size_t G1_RECORD_SIZE = sizeof(uint32_t) + G1_OCTET_SIZE;
+static constexpr size_t G2_RECORD_SIZE = sizeof(uint32_t) + G2_OCTET_SIZE;
+
+// Points generated per unit of work, completed blocks between checkpoints,
+// and points serialized per write when exporting
+static constexpr uint64_t GENERATE_BLOCK_SIZE = 4096;
+static constexpr uint64_t CHECKPOINT_INTERVAL = 16;
+static constexpr uint64_t EXPORT_BLOCK_SIZE = 65536;
+
+static const char CHECKPOINT_MAGIC[8] = { 'K', 'Z', 'G', 'C', 'K', 'P', 'T', '1' };
+
+struct setup_checkpoint {
+  uint64_t num_coeff;
+  uint64_t done_blocks;
+  char secret[MODBYTES_CURVE];
+};
+
+// memset that the compiler is not allowed to drop
+static void secure_zero(void* data, size_t size) {
+  volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+  while (size--)
+    *p++ = 0;
+}
+
+static void write_G1_record(uint8_t* dst, ECP& point) {
+  octet oct = {0, G1_OCTET_SIZE, reinterpret_cast<char*>(dst + sizeof(uint32_t))};
+  ECP_toOctet(&oct, &point, false);
+  if (oct.len != G1_OCTET_SIZE)
+    throw runtime_error("trusted setup contains the point at infinity");
+
+  uint32_t len = static_cast<uint32_t>(oct.len);
+  memcpy(dst, &len, sizeof(len));
+}
+
+static void write_G2_record(uint8_t* dst, ECP2& point) {
+  octet oct = {0, G2_OCTET_SIZE, reinterpret_cast<char*>(dst + sizeof(uint32_t))};
+  ECP2_toOctet(&oct, &point, false);
+  if (oct.len != G2_OCTET_SIZE)
+    throw runtime_error("trusted setup contains the point at infinity");
+
+  uint32_t len = static_cast<uint32_t>(oct.len);
+  memcpy(dst, &len, sizeof(len));
+}
+
+static void write_at(int fd, const void* data, size_t size, off_t offset) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, p, size, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw runtime_error("could not write trusted setup file");
+    }
+    p += written;
+    size -= written;
+    offset += written;
+  }
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+  uint8_t* p = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// The checkpoint holds the secret, so it is only ever readable by its owner.
+// It is written to a temporary file and renamed so that a crash while saving
+// leaves the previous checkpoint intact.
+static void save_checkpoint(const std::string& filename, const setup_checkpoint& state) {
+  std::string tmp_filename = filename + ".tmp";
+  int fd = open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+  if (fd < 0)
+    throw runtime_error("could not write checkpoint file");
+
+  try {
+    if (fchmod(fd, S_IRUSR | S_IWUSR) != 0)
+      throw runtime_error("could not restrict checkpoint file permissions");
+    write_at(fd, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 0);
+    write_at(fd, &state, sizeof(state), sizeof(CHECKPOINT_MAGIC));
+    if (fsync(fd) != 0)
+      throw runtime_error("could not write checkpoint file");
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not write checkpoint file");
+}
+
+static bool load_checkpoint(const std::string& filename, setup_checkpoint& state) {
+  int fd = open(filename.c_str(), O_RDONLY | O_NOFOLLOW);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return false;
+    throw runtime_error("could not open checkpoint file");
+  }
+
+  struct stat st;
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  bool ok = fstat(fd, &st) == 0 && (st.st_mode & (S_IRWXG | S_IRWXO)) == 0
+    && read_all(fd, magic, sizeof(magic)) && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0
+    && read_all(fd, &state, sizeof(state));
+  close(fd);
+
+  if (!ok) {
+    secure_zero(&state, sizeof(state));
+    throw runtime_error("bad checkpoint file (or it is accessible by other users)");
+  }
+  return true;
+}
+
+// Overwrites the secret on disk before removing the checkpoint
+static void wipe_checkpoint(const std::string& filename) {
+  int fd = open(filename.c_str(), O_WRONLY | O_NOFOLLOW);
+  if (fd >= 0) {
+    std::vector<uint8_t> zeros(sizeof(CHECKPOINT_MAGIC) + sizeof(setup_checkpoint), 0);
+    write_at(fd, zeros.data(), zeros.size(), 0);
+    fsync(fd);
+    close(fd);
+  }
+  unlink(filename.c_str());
+}
+
+void kzg::trusted_setup::generate_setup_file(const std::string& filename, int num_coeff, const std::string& checkpoint_filename) {
+  if (num_coeff < 2) {
+    throw invalid_argument("num_coeff must be at least 2");
+  }
+
+  std::string checkpoint = checkpoint_filename.empty() ? filename + ".checkpoint" : checkpoint_filename;
+  uint64_t n = static_cast<uint64_t>(num_coeff);
+
+  setup_checkpoint state;
+  bool resume = load_checkpoint(checkpoint, state);
+  if (resume && state.num_coeff != n) {
+    secure_zero(&state, sizeof(state));
+    throw invalid_argument("checkpoint belongs to a setup of a different size");
+  }
+
+  if (!resume) {
+    BIG BIG_s;
+    do {
+      generate_random_BIG(BIG_s);
+    } while (BIG_iszilch(BIG_s));
+
+    state.num_coeff = n;
+    state.done_blocks = 0;
+    BIG_toBytes(state.secret, BIG_s);
+    secure_zero(BIG_s, sizeof(BIG_s));
+    save_checkpoint(checkpoint, state);
+  }
+
+  // an existing file is only truncated when starting over, blocks written
+  // before the last checkpoint are kept
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    secure_zero(&state, sizeof(state));
+    throw runtime_error("could not open trusted setup file");
+  }
+
+  fr s;
+  {
+    BIG BIG_s;
+    BIG_fromBytes(BIG_s, state.secret);
+    fr_from_BIG(s, BIG_s);
+    secure_zero(BIG_s, sizeof(BIG_s));
+  }
+
+  uint64_t num_blocks = (n + GENERATE_BLOCK_SIZE - 1) / GENERATE_BLOCK_SIZE;
+  std::atomic<uint64_t> next_block(state.done_blocks);
+  std::vector<char> finished(num_blocks, 0);
+  uint64_t watermark = state.done_blocks;
+  uint64_t checkpointed = watermark;
+  std::mutex progress_mutex;
+  std::exception_ptr error;
+
+  // Workers claim blocks in order, write them at their final offset and
+  // advance the watermark of contiguously finished blocks. Only the
+  // watermark is checkpointed, after the data below it is synced to disk.
+  auto worker = [&]() {
+    std::vector<uint8_t> G1_buffer(GENERATE_BLOCK_SIZE * G1_RECORD_SIZE);
+    std::vector<uint8_t> G2_buffer(GENERATE_BLOCK_SIZE * G2_RECORD_SIZE);
+    try {
+      for (uint64_t b = next_block++; b < num_blocks; b = next_block++) {
+        uint64_t start = b * GENERATE_BLOCK_SIZE;
+        uint64_t end = std::min(start + GENERATE_BLOCK_SIZE, n);
+
+        fr s_i;
+        fr_pow(s_i, s, &start, 1);
+        BIG scalar;
+        for (uint64_t i = start; i < end; i++) {
+          fr_to_BIG(scalar, s_i);
+
+          ECP G1_s_i;
+          ECP_generator(&G1_s_i);
+          PAIR_G1mul(&G1_s_i, scalar);
+          write_G1_record(&G1_buffer[(i - start) * G1_RECORD_SIZE], G1_s_i);
+
+          ECP2 G2_s_i;
+          ECP2_generator(&G2_s_i);
+          PAIR_G2mul(&G2_s_i, scalar);
+          write_G2_record(&G2_buffer[(i - start) * G2_RECORD_SIZE], G2_s_i);
+
+          fr_mul(s_i, s_i, s);
+        }
+        secure_zero(&s_i, sizeof(s_i));
+        secure_zero(scalar, sizeof(scalar));
+
+        write_at(fd, G1_buffer.data(), (end - start) * G1_RECORD_SIZE, HEADER_SIZE + start * G1_RECORD_SIZE);
+        write_at(fd, G2_buffer.data(), (end - start) * G2_RECORD_SIZE, HEADER_SIZE + n * G1_RECORD_SIZE + start * G2_RECORD_SIZE);
+
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        finished[b] = 1;
+        while (watermark < num_blocks && finished[watermark])
+          watermark++;
+
+        if (watermark < num_blocks && watermark - checkpointed >= CHECKPOINT_INTERVAL) {
+          if (fdatasync(fd) != 0)
+            throw runtime_error("could not write trusted setup file");
+          state.done_blocks = watermark;
+          save_checkpoint(checkpoint, state);
+          checkpointed = watermark;
+        }
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(progress_mutex);
+      if (!error)
+        error = std::current_exception();
+      next_block = num_blocks;
+    }
+  };
+
+  try {
+    write_at(fd, &n, sizeof(n), 0);
+
+    unsigned int num_threads = std::min<uint64_t>(kzg::PROFILE.thread_count(), num_blocks - state.done_blocks);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < num_threads; t++)
+      threads.push_back(std::thread(worker));
+    worker();
+    for (auto& thread : threads)
+      thread.join();
+
+    if (error)
+      std::rethrow_exception(error);
+    if (fsync(fd) != 0)
+      throw runtime_error("could not write trusted setup file");
+  } catch (...) {
+    // the checkpoint stays on disk so that the generation can be resumed
+    close(fd);
+    secure_zero(&s, sizeof(s));
+    secure_zero(&state, sizeof(state));
+    throw;
+  }
+
+  close(fd);
+  secure_zero(&s, sizeof(s));
+  secure_zero(&state, sizeof(state));
+  wipe_checkpoint(checkpoint);
+}
+
+// Records start to start + count of a group, serialized in parallel
+static void encode_G1_records(uint8_t* buffer, const kzg::point_table<kzg::G1_affine>& G1, uint64_t start, uint64_t count) {
+  parallel_ranges(count, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; i++) {
+      ECP point;
+      ECP_from_affine(point, G1[start + i]);
+      write_G1_record(&buffer[i * G1_RECORD_SIZE], point);
+    }
+  });
+}
+
+static void encode_G2_records(uint8_t* buffer, const kzg::point_table<kzg::G2_affine>& G2, uint64_t start, uint64_t count) {
+  parallel_ranges(count, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; i++) {
+      ECP2 point;
+      ECP2_from_affine(point, G2[start + i]);
+      write_G2_record(&buffer[i * G2_RECORD_SIZE], point);
+    }
+  });
+}
+
+void kzg::trusted_setup::export_setup(const std::string& filename) {
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "failed to export" << std::endl;
+    return;
+  }
+
+  uint64_t num_coeffs = static_cast<uint64_t>(_G1.size());
+  file.write(reinterpret_cast<const char*>(&num_coeffs), sizeof(num_coeffs));
+
+  // points are serialized in parallel into one large buffer per block, which
+  // is then written with a single call
+  std::vector<uint8_t> buffer(std::min(num_coeffs, EXPORT_BLOCK_SIZE) * G2_RECORD_SIZE);
+
+  for (uint64_t start = 0; start < num_coeffs; start += EXPORT_BLOCK_SIZE) {
+    uint64_t count = std::min(EXPORT_BLOCK_SIZE, num_coeffs - start);
+    encode_G1_records(buffer.data(), _G1, start, count);
+    file.write(reinterpret_cast<const char*>(buffer.data()), count * G1_RECORD_SIZE);
+  }
+
+  for (uint64_t start = 0; start < num_coeffs; start += EXPORT_BLOCK_SIZE) {
+    uint64_t count = std::min(EXPORT_BLOCK_SIZE, num_coeffs - start);
+    encode_G2_records(buffer.data(), _G2, start, count);
+    file.write(reinterpret_cast<const char*>(buffer.data()), count * G2_RECORD_SIZE);
+  }
+
+  file.close();
+}
+
+// Hashes the records export_setup writes, block by block, so the whole setup
+// is never encoded at once
+std::vector<uint8_t> kzg::trusted_setup::digest() const {
+  uint64_t num_coeffs = _G1.size();
+  std::vector<uint8_t> buffer(std::min(num_coeffs, EXPORT_BLOCK_SIZE) * G2_RECORD_SIZE);
+  std::vector<uint8_t> bytes;
+  transcript_append(bytes, std::string("KZG_SETUP_DIGEST_V1"));
+  for (int i = 0; i < 8; i++)
+    bytes.push_back((uint8_t) (num_coeffs >> (8 * i)));
+  
+  char block_digest[32];
+  for (uint64_t start = 0; start < num_coeffs; start += EXPORT_BLOCK_SIZE) {
+    uint64_t count = std::min(EXPORT_BLOCK_SIZE, num_coeffs - start);
+    encode_G1_records(buffer.data(), _G1, start, count);
+    block_sha256(block_digest, buffer.data(), count * G1_RECORD_SIZE);
+    bytes.insert(bytes.end(), block_digest, block_digest + sizeof(block_digest));
+  }
+  
+  for (uint64_t start = 0; start < num_coeffs; start += EXPORT_BLOCK_SIZE) {
+    uint64_t count = std::min(EXPORT_BLOCK_SIZE, num_coeffs - start);
+    encode_G2_records(buffer.data(), _G2, start, count);
+    block_sha256(block_digest, buffer.data(), count * G2_RECORD_SIZE);
+    bytes.insert(bytes.end(), block_digest, block_digest + sizeof(block_digest));
+  }
+  
+  return sha256(bytes);
+}
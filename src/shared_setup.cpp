@@ -0,0 +1,186 @@
+#include <kzg.h>
+#include "util.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char SHARED_MAGIC[8] = { 'K', 'Z', 'G', 'S', 'H', 'M', '0', '1' };
+
+// Start of the segment. The points are stored in the library's in-memory
+// layout, so the header records what that layout depends on: the curve and
+// the sizes of the affine structs.
+struct shared_header {
+  char magic[8];
+  std::atomic<uint32_t> ready;
+  uint32_t G1_size;
+  uint32_t G2_size;
+  char modulus[MODBYTES_CURVE];
+  uint64_t num_coeff;
+  uint64_t G1_offset;
+  uint64_t G2_offset;
+  uint64_t length;
+};
+
+struct shared_mapping {
+  void* addr;
+  size_t length;
+
+  shared_mapping(void* addr, size_t length) : addr(addr), length(length) {}
+  ~shared_mapping() { munmap(addr, length); }
+};
+
+static size_t round_up(size_t value, size_t multiple) {
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+static std::string segment_path(const std::string& name, const kzg::shared_setup_options& options) {
+  if (name.empty() || name.find('/') != std::string::npos)
+    throw invalid_argument("shared setup names must be non-empty and without '/'");
+  return options.hugepage_dir.empty() ? "/" + name : options.hugepage_dir + "/" + name;
+}
+
+static int open_segment(const std::string& name, const kzg::shared_setup_options& options, int flags, mode_t mode) {
+  std::string path = segment_path(name, options);
+  if (options.hugepage_dir.empty())
+    return shm_open(path.c_str(), flags, mode);
+  return open(path.c_str(), flags, mode);
+}
+
+// mbind through the system call, so that libnuma is not needed
+static void place_pages(void* addr, size_t length, const kzg::shared_setup_options& options) {
+  if (options.numa_node < 0 && !options.numa_interleave)
+    return;
+
+  const int max_nodes = 1024;
+  unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {0};
+  int mode;
+  if (options.numa_node >= 0) {
+    if (options.numa_node >= max_nodes - 1)
+      throw invalid_argument("bad NUMA node");
+    mask[options.numa_node / (8 * sizeof(unsigned long))] |= 1UL << (options.numa_node % (8 * sizeof(unsigned long)));
+    mode = MPOL_BIND;
+  } else {
+    if (syscall(SYS_get_mempolicy, NULL, mask, max_nodes, NULL, MPOL_F_MEMS_ALLOWED) != 0)
+      throw runtime_error("could not query the allowed NUMA nodes");
+    mode = MPOL_INTERLEAVE;
+  }
+
+  if (syscall(SYS_mbind, addr, length, mode, mask, max_nodes, 0) != 0)
+    throw runtime_error("could not set the NUMA placement of the shared setup");
+}
+
+std::vector<uint8_t> kzg::trusted_setup::publish_shared(const std::string& name, const kzg::shared_setup_options& options) const {
+  size_t G1_bytes = _G1.size() * sizeof(G1_affine);
+  size_t G2_bytes = _G2.size() * sizeof(G2_affine);
+  size_t G1_offset = round_up(sizeof(shared_header), 64);
+  size_t G2_offset = round_up(G1_offset + G1_bytes, 64);
+  size_t length = G2_offset + G2_bytes;
+
+  int fd = open_segment(name, options, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0)
+    throw runtime_error(errno == EEXIST ? "shared setup exists already" : "could not create shared setup");
+
+  // huge page backed files must be sized in whole huge pages
+  struct stat st;
+  size_t page = sysconf(_SC_PAGESIZE);
+  if (!options.hugepage_dir.empty() && fstat(fd, &st) == 0 && st.st_blksize > 0)
+    page = st.st_blksize;
+  size_t mapped = round_up(length, page);
+
+  void* addr = MAP_FAILED;
+  if (ftruncate(fd, mapped) == 0)
+    addr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    unlink_shared(name, options);
+    throw runtime_error("could not map shared setup");
+  }
+
+  try {
+    if (options.hugepage_dir.empty())
+      madvise(addr, mapped, MADV_HUGEPAGE);
+    place_pages(addr, mapped, options);
+  } catch (...) {
+    munmap(addr, mapped);
+    unlink_shared(name, options);
+    throw;
+  }
+
+  char* base = static_cast<char*>(addr);
+  memcpy(base + G1_offset, _G1.data(), G1_bytes);
+  memcpy(base + G2_offset, _G2.data(), G2_bytes);
+
+  shared_header* header = new (addr) shared_header;
+  memcpy(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+  header->G1_size = sizeof(G1_affine);
+  header->G2_size = sizeof(G2_affine);
+  curve_modulus(header->modulus);
+  header->num_coeff = _G1.size();
+  header->G1_offset = G1_offset;
+  header->G2_offset = G2_offset;
+  header->length = length;
+  header->ready.store(1, std::memory_order_release);
+
+  munmap(addr, mapped);
+  return digest();
+}
+
+kzg::trusted_setup kzg::trusted_setup::attach_shared(const std::string& name, const std::vector<uint8_t>& expected_digest, const kzg::shared_setup_options& options) {
+  int fd = open_segment(name, options, O_RDONLY | O_NOFOLLOW, 0);
+  if (fd < 0)
+    throw runtime_error("could not open shared setup");
+
+  // a segment someone else could have created or can still change is not used
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    close(fd);
+    throw runtime_error("shared setup is not owned by this user or is writable by others");
+  }
+
+  void* addr = MAP_FAILED;
+  if (st.st_size >= (off_t) sizeof(shared_header))
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw runtime_error("could not map shared setup");
+
+  auto mapping = std::make_shared<shared_mapping>(addr, st.st_size);
+  const shared_header* header = static_cast<const shared_header*>(addr);
+  if (memcmp(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0 || header->length > (uint64_t) st.st_size)
+    throw runtime_error("bad shared setup");
+  if (header->ready.load(std::memory_order_acquire) != 1)
+    throw runtime_error("shared setup is still being published");
+
+  char modulus[MODBYTES_CURVE];
+  curve_modulus(modulus);
+  if (header->G1_size != sizeof(G1_affine) || header->G2_size != sizeof(G2_affine) || memcmp(header->modulus, modulus, sizeof(modulus)) != 0)
+    throw runtime_error("shared setup was published by a build for another curve");
+  if (header->G1_offset + header->num_coeff * sizeof(G1_affine) > header->length
+      || header->G2_offset + header->num_coeff * sizeof(G2_affine) > header->length)
+    throw runtime_error("bad shared setup");
+
+  // the tables alias the mapping, which is unmapped with the last of them
+  char* base = static_cast<char*>(addr);
+  point_table<G1_affine> G1(std::shared_ptr<G1_affine>(mapping, reinterpret_cast<G1_affine*>(base + header->G1_offset)), header->num_coeff);
+  point_table<G2_affine> G2(std::shared_ptr<G2_affine>(mapping, reinterpret_cast<G2_affine*>(base + header->G2_offset)), header->num_coeff);
+  trusted_setup setup(G1, G2);
+  if (setup.digest() != expected_digest)
+    throw runtime_error("shared setup does not match the expected digest");
+  return setup;
+}
+
+void kzg::trusted_setup::unlink_shared(const std::string& name, const kzg::shared_setup_options& options) {
+  std::string path = segment_path(name, options);
+  if (options.hugepage_dir.empty())
+    shm_unlink(path.c_str());
+  else
+    unlink(path.c_str());
+}
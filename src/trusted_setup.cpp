@@ -1,22 +1,79 @@
 #include <kzg.h>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <fstream>
 #include <cstdint>
 #include <thread>
 #include <vector>
 #include <functional>
+#include <map>
 #include "util.h"
+#include "field.h"
+#include "msm.h"
+#include "lru_cache.h"
 
 int kzg::CURVE_ORDER_BYTES;
 
+struct verify_window {
+  ZZ_pX Z;
+  ECP2 Z_G2;
+};
+
+// Verifier state for windows of consecutive points. Windows are keyed by
+// (offset, length), and the interpolation weights only by length since they
+// are invariant under a shift of the window.
+class kzg::verify_cache {
+public:
+  lru_cache<pair<int, int>, std::shared_ptr<const verify_window>> windows;
+  lru_cache<int, std::shared_ptr<const vector<ZZ_p>>> weights;
+  
+  verify_cache(int capacity) : windows(capacity), weights(capacity) {}
+};
+
 static constexpr size_t G1_OCTET_SIZE = 2 * MODBYTES_CURVE + 1;
 static constexpr size_t G2_OCTET_SIZE = 4 * MODBYTES_CURVE + 1;
 
+// Points converted to affine per batch inversion
+static constexpr int NORMALIZE_BLOCK_SIZE = 256;
+
+// Polynomials committed to together by create_commits, msm_G1_batch splits a
+// batch further when its windows are wide
+static constexpr int COMMIT_BATCH_SIZE = 32;
+
 void kzg::init() {
   ZZ ZZ_curve_order = ZZ_from_BIG(CURVE_Order);
   ZZ_p::init(ZZ_curve_order);
   kzg::CURVE_ORDER_BYTES = NumBytes(ZZ_curve_order);
-}  
+  fr_init();
+  
+  const char* profile_filename = getenv("KZG_PROFILE");
+  if (profile_filename != NULL)
+    kzg::PROFILE = kzg::profile::load(profile_filename);
+}
+
+void kzg::init(const std::string& profile_filename) {
+  kzg::init();
+  kzg::PROFILE = kzg::profile::load(profile_filename);
+}
+
+// Converts the coefficients of P into the workspace's curve scalars
+// The canonical ZZ_p limbs are repacked into BIG chunks directly, the
+// coefficients never pass through Montgomery form
+static void coeffs_to_BIGs(BIG* scalars, const ZZ_pX& P) {
+  size_t n = deg(P) + 1;
+  for (size_t i = 0; i < n; i++)
+    BIG_from_ZZ(scalars[i], rep(P[i]));
+}
+
+static void coeffs_to_BIGs(kzg::workspace::state& ws, const ZZ_pX& P) {
+  size_t n = deg(P) + 1;
+  if (ws.scalars.size() < n)
+    ws.scalars = std::vector<BIG>(n);
+  
+  coeffs_to_BIGs(ws.scalars.data(), P);
+}
 
 kzg::trusted_setup::trusted_setup(int num_coeff) {
   if (num_coeff < 2) {
@@ -27,8 +84,9 @@ kzg::trusted_setup::trusted_setup(int num_coeff) {
   generate_random_BIG(BIG_s);
   ZZ_p s = conv<ZZ_p>(ZZ_from_BIG(BIG_s));
 
-  _G1.resize(num_coeff);
-  _G2.resize(num_coeff);
+  _G1.allocate(num_coeff);
+  _G2.allocate(num_coeff);
+  _verify_cache = std::make_shared<verify_cache>(kzg::PROFILE.verify_cache_size);
 
   std::vector<BIG> s_powers(num_coeff);
   for (int i = 0; i < num_coeff; i++) {
@@ -36,10 +94,7 @@ kzg::trusted_setup::trusted_setup(int num_coeff) {
     BIG_from_ZZ(s_powers[i], rep(s_i));
   }
 
-  unsigned int num_threads = std::thread::hardware_concurrency();
-  
-  if (num_threads == 0)
-    num_threads = 4;
+  unsigned int num_threads = kzg::PROFILE.thread_count();
   
   if (num_coeff < num_threads) {
     generate_elements_range(0, num_coeff, std::cref(s_powers));
@@ -84,53 +139,71 @@ kzg::trusted_setup::trusted_setup(const std::string& filename) {
   uint64_t num_coeffs;
   file.read(reinterpret_cast<char*>(&num_coeffs), sizeof(num_coeffs));
   
-  _G1.reserve(static_cast<size_t>(num_coeffs));
-  _G2.reserve(static_cast<size_t>(num_coeffs));
+  _G1.allocate(static_cast<size_t>(num_coeffs));
+  _G2.allocate(static_cast<size_t>(num_coeffs));
+  _verify_cache = std::make_shared<verify_cache>(kzg::PROFILE.verify_cache_size);
   
-  for (uint64_t i = 0; i < num_coeffs; i++) {
-    uint32_t len;
-    file.read(reinterpret_cast<char*>(&len), sizeof(len));
-    char buffer[G1_OCTET_SIZE];
-    file.read(buffer, len);
-    
-    octet oct = {static_cast<int>(len), G1_OCTET_SIZE, buffer};
-    ECP point;
-    if (ECP_fromOctet(&point, &oct)) {
-      _G1.push_back(point);
-    } else {
-      throw runtime_error("bad trusted setup file");
+  std::vector<ECP> G1_block(NORMALIZE_BLOCK_SIZE);
+  for (uint64_t start = 0; start < num_coeffs; start += NORMALIZE_BLOCK_SIZE) {
+    uint64_t count = std::min<uint64_t>(NORMALIZE_BLOCK_SIZE, num_coeffs - start);
+    for (uint64_t i = 0; i < count; i++) {
+      uint32_t len;
+      file.read(reinterpret_cast<char*>(&len), sizeof(len));
+      if (!file || len > G1_OCTET_SIZE)
+        throw runtime_error("bad trusted setup file");
+      char buffer[G1_OCTET_SIZE];
+      file.read(buffer, len);
+      
+      octet oct = {static_cast<int>(len), G1_OCTET_SIZE, buffer};
+      if (!ECP_fromOctet(&G1_block[i], &oct))
+        throw runtime_error("bad trusted setup file");
     }
+    normalize_G1(&_G1[start], G1_block.data(), count);
   }
   
-  for (uint64_t i = 0; i < num_coeffs; i++) {
-    uint32_t len;
-    file.read(reinterpret_cast<char*>(&len), sizeof(len));
-    char buffer[G2_OCTET_SIZE];
-    file.read(buffer, len);
-    
-    octet oct = {static_cast<int>(len), G2_OCTET_SIZE, buffer};
-    ECP2 point;
-    if (ECP2_fromOctet(&point, &oct)) {
-      _G2.push_back(point);
-    } else {
-      throw logic_error("bad trusted setup file");
+  std::vector<ECP2> G2_block(NORMALIZE_BLOCK_SIZE);
+  for (uint64_t start = 0; start < num_coeffs; start += NORMALIZE_BLOCK_SIZE) {
+    uint64_t count = std::min<uint64_t>(NORMALIZE_BLOCK_SIZE, num_coeffs - start);
+    for (uint64_t i = 0; i < count; i++) {
+      uint32_t len;
+      file.read(reinterpret_cast<char*>(&len), sizeof(len));
+      if (!file || len > G2_OCTET_SIZE)
+        throw runtime_error("bad trusted setup file");
+      char buffer[G2_OCTET_SIZE];
+      file.read(buffer, len);
+      
+      octet oct = {static_cast<int>(len), G2_OCTET_SIZE, buffer};
+      if (!ECP2_fromOctet(&G2_block[i], &oct))
+        throw logic_error("bad trusted setup file");
     }
+    normalize_G2(&_G2[start], G2_block.data(), count);
   }
   
   file.close();
 }
 
+kzg::trusted_setup::trusted_setup(kzg::point_table<kzg::G1_affine> G1, kzg::point_table<kzg::G2_affine> G2)
+  : _G1(G1), _G2(G2) {
+  ZZ z = ZZ_from_BIG(CURVE_Order);
+  ZZ_p::init(z);
+  _verify_cache = std::make_shared<verify_cache>(kzg::PROFILE.verify_cache_size);
+}
+
 void kzg::trusted_setup::generate_elements_range(int start, int end, const std::vector<BIG>& s_powers) {
-  for (int i = start; i < end; i++) {
-    ECP G1_s_i;
-    ECP_generator(&G1_s_i);
-    PAIR_G1mul(&G1_s_i, const_cast<BIG&>(s_powers[i]));
-    _G1[i] = G1_s_i;
-
-    ECP2 G2_s_i;
-    ECP2_generator(&G2_s_i);
-    PAIR_G2mul(&G2_s_i, const_cast<BIG&>(s_powers[i]));
-    _G2[i] = G2_s_i;
+  std::vector<ECP> G1_block(NORMALIZE_BLOCK_SIZE);
+  std::vector<ECP2> G2_block(NORMALIZE_BLOCK_SIZE);
+  
+  for (int block = start; block < end; block += NORMALIZE_BLOCK_SIZE) {
+    int count = std::min(NORMALIZE_BLOCK_SIZE, end - block);
+    for (int i = 0; i < count; i++) {
+      ECP_generator(&G1_block[i]);
+      PAIR_G1mul(&G1_block[i], const_cast<BIG&>(s_powers[block + i]));
+      
+      ECP2_generator(&G2_block[i]);
+      PAIR_G2mul(&G2_block[i], const_cast<BIG&>(s_powers[block + i]));
+    }
+    normalize_G1(&_G1[block], G1_block.data(), count);
+    normalize_G2(&_G2[block], G2_block.data(), count);
   }
 }
 
@@ -141,61 +214,119 @@ kzg::commit kzg::trusted_setup::create_commit(const kzg::poly& poly) {
   return kzg::commit(polyeval_G1(poly.get_poly()));
 }
 
+std::vector<kzg::commit> kzg::trusted_setup::create_commits(const std::vector<kzg::poly>& polys) {
+  size_t m = polys.size();
+  std::vector<size_t> starts(m + 1, 0);
+  for (size_t j = 0; j < m; j++) {
+    if (deg(polys[j].get_poly()) + 1 >= _G1.size())
+      throw invalid_argument("polynomial degree be at most one less than the setup size (num_coeffs)");
+    starts[j + 1] = starts[j] + deg(polys[j].get_poly()) + 1;
+  }
+  
+  // threads take contiguous runs of polynomials, and commit to each run in
+  // batches that share the passes over the setup
+  std::vector<BIG> scalars(starts[m]);
+  std::vector<ECP> points(m);
+  ZZ_pContext context;
+  context.save();
+  parallel_ranges(m, [&](uint64_t begin, uint64_t end) {
+    context.restore();
+    std::vector<BIG*> batch_scalars;
+    std::vector<int> batch_lengths;
+    for (uint64_t j = begin; j < end; j++)
+      coeffs_to_BIGs(&scalars[starts[j]], polys[j].get_poly());
+    
+    // a fixed-base table already removes most of the doublings and bucket
+    // sums, sharing base loads across a batch saves less than it does
+    if (_G1_stride > 0) {
+      for (uint64_t j = begin; j < end; j++) {
+        int n = starts[j + 1] - starts[j];
+        if (n >= kzg::PROFILE.msm_g1_threshold)
+          fixed_base_msm_G1(points[j], _G1_shifted.data(), _G1_shifted.size() / _G1.size(), _G1_stride, &scalars[starts[j]], n);
+        else
+          msm_G1(points[j], _G1.data(), &scalars[starts[j]], n);
+      }
+      return;
+    }
+    
+    for (uint64_t batch = begin; batch < end; batch += COMMIT_BATCH_SIZE) {
+      uint64_t batch_end = std::min<uint64_t>(batch + COMMIT_BATCH_SIZE, end);
+      batch_scalars.clear();
+      batch_lengths.clear();
+      for (uint64_t j = batch; j < batch_end; j++) {
+        batch_scalars.push_back(&scalars[starts[j]]);
+        batch_lengths.push_back(starts[j + 1] - starts[j]);
+      }
+      msm_G1_batch(&points[batch], _G1.data(), batch_scalars.data(), batch_lengths.data(), batch_end - batch);
+    }
+  });
+  
+  // one shared inversion brings every nonzero commitment to z = 1
+  std::vector<ECP> finite;
+  for (auto& P : points) {
+    if (!ECP_isinf(&P))
+      finite.push_back(P);
+  }
+  std::vector<kzg::G1_affine> affine(finite.size());
+  normalize_G1(affine.data(), finite.data(), finite.size());
+  
+  std::vector<kzg::commit> commits;
+  commits.reserve(m);
+  size_t k = 0;
+  for (auto& P : points) {
+    if (!ECP_isinf(&P))
+      ECP_from_affine(P, affine[k++]);
+    commits.push_back(kzg::commit(P));
+  }
+  
+  return commits;
+}
+
 bool kzg::trusted_setup::verify_commit(kzg::commit& commit, const kzg::poly& poly) {
   kzg::commit expected_commit = create_commit(poly);
   return ECP_equals(&commit.get_curve_point(), &expected_commit.get_curve_point());
 }
 
 ECP kzg::trusted_setup::polyeval_G1(const ZZ_pX& P) {
+  kzg::workspace::state ws;
+  return polyeval_G1(P, ws);
+}
+
+ECP kzg::trusted_setup::polyeval_G1(const ZZ_pX& P, kzg::workspace::state& ws) {
   if (deg(P) == -1) {
     ECP inf;
     ECP_inf(&inf);
     return inf;
   }
 
-  BIG coeff_i;
-  BIG_from_ZZ(coeff_i, rep(P[0]));
+  coeffs_to_BIGs(ws, P);
   
   ECP res;
-  ECP_copy(&res, &_G1[0]);
-  PAIR_G1mul(&res, coeff_i);
-  
-  for (int i = 1; i <= deg(P); i++) {
-    BIG_from_ZZ(coeff_i, rep(P[i]));
-    
-    ECP term;
-    ECP_copy(&term, &_G1[i]);
-    PAIR_G1mul(&term, coeff_i);
-    
-    ECP_add(&res, &term);
-  }
+  int n = deg(P) + 1;
+  if (_G1_stride > 0 && n >= kzg::PROFILE.msm_g1_threshold)
+    fixed_base_msm_G1(res, _G1_shifted.data(), _G1_shifted.size() / _G1.size(), _G1_stride, ws.scalars.data(), n);
+  else
+    msm_G1(res, _G1.data(), ws.scalars.data(), n);
   
   return res;
 }
 
 ECP2 kzg::trusted_setup::polyeval_G2(const ZZ_pX& P) {
+  kzg::workspace::state ws;
+  return polyeval_G2(P, ws);
+}
+
+ECP2 kzg::trusted_setup::polyeval_G2(const ZZ_pX& P, kzg::workspace::state& ws) {
   if (deg(P) == -1) {
     ECP2 inf;
     ECP2_inf(&inf);
     return inf;
   }
 
-  BIG coeff_i;
-  BIG_from_ZZ(coeff_i, rep(P[0]));
+  coeffs_to_BIGs(ws, P);
   
   ECP2 res;
-  ECP2_copy(&res, &_G2[0]);
-  PAIR_G2mul(&res, coeff_i);
-  
-  for (int i = 1; i <= deg(P); i++) {
-    BIG_from_ZZ(coeff_i, rep(P[i]));
-    
-    ECP2 term;
-    ECP2_copy(&term, &_G2[i]);
-    PAIR_G2mul(&term, coeff_i);
-    
-    ECP2_add(&res, &term);
-  }
+  msm_G2(res, _G2.data(), ws.scalars.data(), deg(P) + 1);
   
   return res;
 }
@@ -212,22 +343,58 @@ kzg::proof kzg::trusted_setup::create_proof(const kzg::poly& poly, int byte_offs
 }
 
 kzg::proof kzg::trusted_setup::create_proof(const kzg::poly& poly, int chunk_offset, int chunk_length) {
+  kzg::workspace workspace;
+  return create_proof(poly, chunk_offset, chunk_length, workspace);
+}
+
+kzg::proof kzg::trusted_setup::create_proof(const kzg::poly& poly, int chunk_offset, int chunk_length, kzg::workspace& workspace) {
   if (chunk_length < 1)
       throw invalid_argument("chunk_length must be 1 or greater");
 
   const ZZ_pX& P = poly.get_poly();
+  kzg::workspace::state& ws = workspace.get_state();
+  
+  // The interpolant I of P over the window is P mod Z, so the quotient of
+  // (P - I) / Z is just the quotient of P / Z and I never has to be built.
+  if (chunk_length == 1) {
+    ZZ_p a;
+    a = chunk_offset;
+    quotient_linear(ws.q, P, a, ws);
+  } else {
+    vanishing_poly(ws.Z, chunk_offset, chunk_length, ws);
+    quotient_vanishing(ws.q, P, ws.Z, ws);
+  }
   
-  vector<pair<ZZ_p, ZZ_p>> points;
-  evaluate_polynomial_points(points, P, chunk_offset, chunk_length);
+  return kzg::proof(polyeval_G1(ws.q, ws));
+}
+
+kzg::proof kzg::trusted_setup::create_proof(const kzg::poly& poly, const std::vector<int>& chunk_indices) {
+  if (chunk_indices.empty())
+    throw invalid_argument("chunk_indices must not be empty");
   
-  ZZ_pX I, Z;
-  linear_roots_and_polyfit(I, Z, points);
-  ZZ_pX q = (P - I) / Z;
+  std::vector<int> sorted = chunk_indices;
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted[0] < 0)
+    throw invalid_argument("chunk indices must be non-negative");
+  else if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+    throw invalid_argument("chunk indices must be distinct");
   
-  return kzg::proof(polyeval_G1(q));
+  // as for windows, the quotient of (P - I) / Z is the quotient of P / Z
+  kzg::workspace::state ws;
+  vanishing_poly(ws.Z, sorted, ws);
+  quotient_vanishing(ws.q, poly.get_poly(), ws.Z, ws);
+  
+  return kzg::proof(polyeval_G1(ws.q, ws));
 }
 
 bool kzg::trusted_setup::verify_proof(kzg::commit& commit, kzg::proof& proof, kzg::blob& expected_data) {
+  kzg::workspace workspace;
+  return verify_proof(commit, proof, expected_data, workspace);
+}
+
+// A proof for data I over the points with vanishing polynomial Z holds iff
+// e(proof, [Z(s)]2) = e(commit - [I(s)]1, [1]2), this computes both points.
+bool kzg::trusted_setup::verify_terms(ECP& D, ECP2& Z_G2, kzg::commit& commit, kzg::blob& expected_data, kzg::workspace::state& ws) {
   vector<pair<ZZ_p, ZZ_p>>& points = expected_data.get_data();
 
   if (points.size() < 1)
@@ -235,54 +402,454 @@ bool kzg::trusted_setup::verify_proof(kzg::commit& commit, kzg::proof& proof, kz
   else if (points.size() >= _G1.size())
     return false;
   
-  ZZ_pX I, Z;
-  linear_roots_and_polyfit(I, Z, points);
+  ZZ_pX I;
+  int offset;
+  if (consecutive_window(offset, points)) {
+    int length = points.size();
+    
+    std::shared_ptr<const verify_window> window;
+    if (!_verify_cache->windows.get({ offset, length }, window)) {
+      auto entry = std::make_shared<verify_window>();
+      vanishing_poly(entry->Z, offset, length, ws);
+      entry->Z_G2 = polyeval_G2(entry->Z, ws);
+      _verify_cache->windows.put({ offset, length }, entry);
+      window = entry;
+    }
+    
+    if (length < kzg::PROFILE.fast_multieval_threshold) {
+      std::shared_ptr<const vector<ZZ_p>> weights;
+      if (!_verify_cache->weights.get(length, weights)) {
+        auto entry = std::make_shared<vector<ZZ_p>>();
+        window_weights(*entry, length);
+        _verify_cache->weights.put(length, entry);
+        weights = entry;
+      }
+      interpolate_window(I, window->Z, points, *weights, ws);
+    } else {
+      interpolate_consecutive(I, points, offset, ws);
+    }
+    
+    Z_G2 = window->Z_G2;
+  } else {
+    linear_roots_and_polyfit(I, ws.Z, points, ws);
+    Z_G2 = polyeval_G2(ws.Z, ws);
+  }
   
-  ECP2 p1 = polyeval_G2(Z);
-  FP12 v1;
-  PAIR_ate(&v1, &p1, &proof.get_curve_point());
-  PAIR_fexp(&v1);
+  D = polyeval_G1(I, ws);
+  ECP_neg(&D);
+  ECP_add(&D, &commit.get_curve_point());
+  return true;
+}
+
+bool kzg::trusted_setup::verify_proof(kzg::commit& commit, kzg::proof& proof, kzg::blob& expected_data, kzg::workspace& workspace) {
+  ECP D;
+  ECP2 Z_G2;
+  if (!verify_terms(D, Z_G2, commit, expected_data, workspace.get_state()))
+    return false;
   
-  ECP p2 = polyeval_G1(I);
-  ECP_neg(&p2);
-  ECP_add(&p2, &commit.get_curve_point());
-  FP12 v2;
-  PAIR_ate(&v2, &_G2[0], &p2);
-  PAIR_fexp(&v2);
+  // e(proof, [Z(s)]2) * e(-D, [1]2) = 1 with a shared final exponentiation
+  ECP2 G2_0;
+  ECP2_from_affine(G2_0, _G2[0]);
+  ECP_neg(&D);
+  FP12 v;
+  PAIR_double_ate(&v, &Z_G2, &proof.get_curve_point(), &G2_0, &D);
+  PAIR_fexp(&v);
   
-  return FP12_equals(&v1, &v2);
+  return FP12_isunity(&v);
 }
 
-void kzg::trusted_setup::export_setup(const std::string& filename) {
-  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
-  if (!file.is_open()) {
-    std::cerr << "failed to export" << std::endl;
-    return;
-  }
+std::vector<bool> kzg::trusted_setup::verify_proofs(std::vector<kzg::commit>& commits, std::vector<kzg::proof>& proofs, std::vector<kzg::blob>& expected_data) {
+  if (commits.size() != proofs.size() || commits.size() != expected_data.size())
+    throw invalid_argument("commits, proofs and expected_data must be of the same size");
+  
+  size_t n = commits.size();
+  std::vector<ECP> D(n);
+  std::vector<ECP2> Z_G2(n);
+  std::vector<std::pair<int, int>> keys(n);
+  std::vector<uint8_t> valid(n);
   
-  uint64_t num_coeffs = static_cast<uint64_t>(_G1.size());
-  file.write(reinterpret_cast<const char*>(&num_coeffs), sizeof(num_coeffs));
+  ZZ_pContext context;
+  context.save();
+  parallel_ranges(n, [&](uint64_t begin, uint64_t end) {
+    context.restore();
+    kzg::workspace::state ws;
+    for (uint64_t i = begin; i < end; i++) {
+      int offset;
+      vector<pair<ZZ_p, ZZ_p>>& points = expected_data[i].get_data();
+      valid[i] = verify_terms(D[i], Z_G2[i], commits[i], expected_data[i], ws);
+      
+      // proofs over the same window pair with the same [Z(s)]2
+      if (consecutive_window(offset, points))
+        keys[i] = { offset, (int) points.size() };
+      else
+        keys[i] = { -1, (int) i };
+    }
+  });
   
-  for (uint64_t i = 0; i < num_coeffs; i++) {
-    char buffer[G1_OCTET_SIZE];
-    octet oct = {0, G1_OCTET_SIZE, buffer};
-    ECP_toOctet(&oct, &_G1[i], false);
+  // random weights r^i bound to the whole batch, the statement of each record
+  // (its points and values) included, not just the curve points
+  std::vector<uint8_t> transcript;
+  transcript_append(transcript, std::string("KZG_VERIFY_PROOFS_V2"));
+  for (size_t i = 0; i < n; i++) {
+    if (!valid[i])
+      continue;
+    vector<pair<ZZ_p, ZZ_p>>& points = expected_data[i].get_data();
+    transcript_append(transcript, conv<ZZ_p>((long) points.size()));
+    for (auto& point : points) {
+      transcript_append(transcript, point.first);
+      transcript_append(transcript, point.second);
+    }
     
-    uint32_t len = static_cast<uint32_t>(oct.len);
-    file.write(reinterpret_cast<const char*>(&len), sizeof(len));
-    file.write(oct.val, oct.len);
+    std::vector<uint8_t> bytes = commits[i].serialize();
+    transcript.insert(transcript.end(), bytes.begin(), bytes.end());
+    bytes = proofs[i].serialize();
+    transcript.insert(transcript.end(), bytes.begin(), bytes.end());
+    bytes = kzg::commit(D[i]).serialize();
+    transcript.insert(transcript.end(), bytes.begin(), bytes.end());
   }
+  ZZ_p r = hash_to_field(transcript);
+  
+  // e(sum r_i proof_i, [Z_w(s)]2) over windows w times e(-sum r_i D_i, [1]2)
+  std::map<std::pair<int, int>, std::vector<size_t>> groups;
+  std::vector<BIG> scalars(n);
+  ZZ_p r_i;
+  r_i = 1;
+  for (size_t i = 0; i < n; i++) {
+    if (!valid[i])
+      continue;
+    groups[keys[i]].push_back(i);
+    BIG_from_ZZ(scalars[i], rep(r_i));
+    r_i *= r;
+  }
+  
+  std::vector<bool> res(n, false);
+  if (groups.empty())
+    return res;
   
-  for (uint64_t i = 0; i < num_coeffs; i++) {
-    char buffer[G2_OCTET_SIZE];
-    octet oct = {0, G2_OCTET_SIZE, buffer};
-    ECP2_toOctet(&oct, &_G2[i], false);
+  // proofs and their weights laid out group by group
+  std::vector<ECP> batch_proofs, batch_D;
+  std::vector<BIG> batch_scalars(n);
+  for (auto& group : groups) {
+    for (size_t i : group.second) {
+      BIG_copy(batch_scalars[batch_D.size()], scalars[i]);
+      batch_proofs.push_back(proofs[i].get_curve_point());
+      batch_D.push_back(D[i]);
+    }
+  }
+  
+  FP12 lines[ATE_BITS_CURVE];
+  PAIR_initmp(lines);
+  size_t begin = 0;
+  for (auto& group : groups) {
+    ECP P;
+    msm_G1(P, &batch_proofs[begin], &batch_scalars[begin], group.second.size());
+    PAIR_another(lines, &Z_G2[group.second[0]], &P);
+    begin += group.second.size();
+  }
+  
+  ECP sum_D;
+  ECP2 G2_0;
+  msm_G1(sum_D, batch_D.data(), batch_scalars.data(), batch_D.size());
+  ECP_neg(&sum_D);
+  ECP2_from_affine(G2_0, _G2[0]);
+  PAIR_another(lines, &G2_0, &sum_D);
+  
+  FP12 v;
+  PAIR_miller(&v, lines);
+  PAIR_fexp(&v);
+  if (FP12_isunity(&v)) {
+    for (size_t i = 0; i < n; i++)
+      res[i] = valid[i];
+    return res;
+  }
+  
+  // some proof is invalid, find which by checking each on its own
+  std::vector<uint8_t> holds(n);
+  parallel_ranges(n, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; i++) {
+      if (!valid[i])
+        continue;
+      ECP neg_D = D[i];
+      ECP_neg(&neg_D);
+      FP12 v;
+      PAIR_double_ate(&v, &Z_G2[i], &proofs[i].get_curve_point(), &G2_0, &neg_D);
+      PAIR_fexp(&v);
+      holds[i] = FP12_isunity(&v);
+    }
+  });
+  for (size_t i = 0; i < n; i++)
+    res[i] = holds[i];
+  return res;
+}
+
+std::pair<ZZ_p, kzg::proof> kzg::trusted_setup::create_opening(const kzg::poly& poly, const ZZ_p& z) {
+  const ZZ_pX& P = poly.get_poly();
+  if (deg(P) + 1 >= _G1.size())
+    throw invalid_argument("polynomial degree be at most one less than the setup size (num_coeffs)");
+  
+  // q = (P - P(z)) / (x - z) is the quotient of P / (x - z)
+  kzg::workspace::state ws;
+  ZZ_p y = eval(P, z);
+  quotient_linear(ws.q, P, z, ws);
+  
+  return { y, kzg::proof(polyeval_G1(ws.q, ws)) };
+}
+
+bool kzg::trusted_setup::verify_opening(kzg::commit& commit, kzg::proof& proof, const ZZ_p& z, const ZZ_p& y) {
+  BIG BIG_z, BIG_y;
+  BIG_from_ZZ(BIG_z, rep(z));
+  BIG_from_ZZ(BIG_y, rep(y));
+  
+  // e(proof, [s]2) = e(commit - [y]1 + z proof, [1]2)
+  ECP rhs, term;
+  ECP_generator(&rhs);
+  mul_vartime_G1(rhs, BIG_y);
+  ECP_neg(&rhs);
+  ECP_add(&rhs, &commit.get_curve_point());
+  ECP_copy(&term, &proof.get_curve_point());
+  mul_vartime_G1(term, BIG_z);
+  ECP_add(&rhs, &term);
+  ECP_neg(&rhs);
+  
+  ECP2 G2_0, G2_1;
+  ECP2_from_affine(G2_0, _G2[0]);
+  ECP2_from_affine(G2_1, _G2[1]);
+  FP12 v;
+  PAIR_double_ate(&v, &G2_1, &proof.get_curve_point(), &G2_0, &rhs);
+  PAIR_fexp(&v);
+  
+  return FP12_isunity(&v);
+}
 
-    uint32_t len = static_cast<uint32_t>(oct.len);
-    file.write(reinterpret_cast<const char*>(&len), sizeof(len));
-    file.write(oct.val, oct.len);
+static ZZ_p batch_challenge(std::vector<kzg::commit>& commits, const ZZ_p& z, const std::vector<ZZ_p>& ys) {
+  std::vector<uint8_t> transcript;
+  transcript_append(transcript, std::string("KZG_BATCH_OPENING_V1"));
+  for (auto& commit : commits) {
+    std::vector<uint8_t> bytes = commit.serialize();
+    transcript.insert(transcript.end(), bytes.begin(), bytes.end());
   }
+  transcript_append(transcript, z);
+  for (auto& y : ys)
+    transcript_append(transcript, y);
   
-  file.close();
+  return hash_to_field(transcript);
+}
+
+std::pair<std::vector<ZZ_p>, kzg::proof> kzg::trusted_setup::create_batch_opening(const std::vector<kzg::poly>& polys, std::vector<kzg::commit>& commits, const ZZ_p& z) {
+  if (polys.empty() || polys.size() != commits.size())
+    throw invalid_argument("polys and commits must be non-empty and of equal size");
+  
+  std::vector<ZZ_p> ys(polys.size());
+  for (size_t i = 0; i < polys.size(); i++)
+    ys[i] = eval(polys[i].get_poly(), z);
+  
+  ZZ_p gamma = batch_challenge(commits, z, ys);
+  
+  // sum gamma^i P_i by Horner's rule
+  ZZ_pX P = polys.back().get_poly();
+  for (size_t i = polys.size() - 1; i-- > 0;)
+    P = P * gamma + polys[i].get_poly();
+  
+  return { ys, create_opening(kzg::poly(P), z).second };
+}
+
+bool kzg::trusted_setup::verify_batch_opening(std::vector<kzg::commit>& commits, kzg::proof& proof, const ZZ_p& z, const std::vector<ZZ_p>& ys) {
+  if (commits.empty() || commits.size() != ys.size())
+    throw invalid_argument("commits and ys must be non-empty and of equal size");
+  
+  ZZ_p gamma = batch_challenge(commits, z, ys);
+  
+  std::vector<ECP> points(commits.size());
+  std::vector<BIG> scalars(commits.size());
+  ZZ_p gamma_i, y;
+  gamma_i = 1;
+  clear(y);
+  for (size_t i = 0; i < commits.size(); i++) {
+    points[i] = commits[i].get_curve_point();
+    BIG_from_ZZ(scalars[i], rep(gamma_i));
+    y += gamma_i * ys[i];
+    gamma_i *= gamma;
+  }
+  
+  ECP C;
+  msm_G1(C, points.data(), scalars.data(), commits.size());
+  kzg::commit combined(C);
+  
+  return verify_opening(combined, proof, z, y);
+}
+
+// Merkle tree over the shard commitments, stored heap style with the leaves
+// at [size, 2 size) for size the shard count rounded up to a power of two.
+// Leaves and inner nodes hash under different prefixes, padding leaves are
+// zero and the shard count is bound by the root, so the layout is unambiguous.
+static std::vector<uint8_t> shard_leaf(kzg::commit& commit) {
+  std::vector<uint8_t> bytes = commit.serialize();
+  bytes.insert(bytes.begin(), 0);
+  return sha256(bytes);
+}
+
+static std::vector<uint8_t> shard_node(const std::vector<uint8_t>& left, const std::vector<uint8_t>& right) {
+  std::vector<uint8_t> bytes(1, 1);
+  bytes.insert(bytes.end(), left.begin(), left.end());
+  bytes.insert(bytes.end(), right.begin(), right.end());
+  return sha256(bytes);
 }
 
+static size_t shard_tree_size(uint64_t num_shards) {
+  size_t size = 1;
+  while (size < num_shards)
+    size *= 2;
+  return size;
+}
+
+static std::vector<std::vector<uint8_t>> shard_tree(std::vector<kzg::commit>& shards) {
+  size_t size = shard_tree_size(shards.size());
+  std::vector<std::vector<uint8_t>> tree(2 * size, std::vector<uint8_t>(32, 0));
+  for (size_t i = 0; i < shards.size(); i++)
+    tree[size + i] = shard_leaf(shards[i]);
+  for (size_t k = size - 1; k >= 1; k--)
+    tree[k] = shard_node(tree[2 * k], tree[2 * k + 1]);
+  return tree;
+}
+
+// The published root, the layout hashed together with the Merkle root
+static std::vector<uint8_t> shard_root(const std::vector<uint8_t>& merkle_root, uint64_t byte_length, int chunk_size, int shard_chunks, uint64_t num_shards) {
+  std::vector<uint8_t> bytes;
+  transcript_append(bytes, std::string("KZG_SHARDED_COMMIT_V2"));
+  
+  uint64_t header[] = { byte_length, (uint64_t) chunk_size, (uint64_t) shard_chunks, num_shards };
+  for (uint64_t value : header) {
+    for (int i = 0; i < 8; i++)
+      bytes.push_back((uint8_t) (value >> (8 * i)));
+  }
+  
+  bytes.insert(bytes.end(), merkle_root.begin(), merkle_root.end());
+  return sha256(bytes);
+}
+
+kzg::sharded_commit kzg::trusted_setup::create_sharded_commit(const uint8_t* bytes, uint64_t byte_length, int chunk_size) {
+  if (chunk_size < 1 || chunk_size > MAX_CHUNK_BYTES)
+    throw invalid_argument("chunk_size must be between 1 and MAX_CHUNK_BYTES.");
+  else if (byte_length == 0 || byte_length % chunk_size != 0)
+    throw invalid_argument("byte_length must be a non-zero multiple of chunk_size.");
+  
+  int shard_chunks = _G1.size() - 1;
+  uint64_t shard_bytes = (uint64_t) shard_chunks * chunk_size;
+  size_t num_shards = (byte_length + shard_bytes - 1) / shard_bytes;
+  
+  ECP inf;
+  ECP_inf(&inf);
+  std::vector<kzg::commit> shards(num_shards, kzg::commit(inf));
+  
+  // workers take shards off a shared counter, each keeps one shard in memory
+  unsigned int num_threads = min<size_t>(kzg::PROFILE.thread_count(), num_shards);
+  std::atomic<size_t> next(0);
+  std::vector<std::exception_ptr> errors(num_threads);
+  ZZ_pContext context;
+  context.save();
+  
+  auto worker = [&](unsigned int t) {
+    context.restore();
+    kzg::workspace workspace;
+    workspace.get_state().threads = max(1u, kzg::PROFILE.thread_count() / num_threads);
+    
+    try {
+      for (size_t shard = next++; shard < num_shards; shard = next++) {
+        uint64_t start = shard * shard_bytes;
+        int length = min<uint64_t>(shard_bytes, byte_length - start);
+        
+        kzg::blob blob = kzg::blob::from_bytes(bytes + start, 0, length, chunk_size);
+        shards[shard] = create_commit(kzg::poly::from_blob(blob, workspace));
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1; t < num_threads; t++)
+    threads.push_back(std::thread(worker, t));
+  worker(0);
+  for (auto& thread : threads)
+    thread.join();
+  
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  
+  std::vector<uint8_t> root = shard_root(shard_tree(shards)[1], byte_length, chunk_size, shard_chunks, num_shards);
+  return kzg::sharded_commit(shards, root, byte_length, chunk_size, shard_chunks);
+}
+
+kzg::sharded_proof kzg::trusted_setup::create_sharded_proof(kzg::sharded_commit& commit, const uint8_t* bytes, uint64_t byte_offset, int byte_length) {
+  int chunk_size = commit.get_chunk_size();
+  if (byte_offset % chunk_size != 0)
+    throw invalid_argument("byte_offset is not a multiple of chunk_size.");
+  else if (byte_length < 1 || byte_length % chunk_size != 0)
+    throw invalid_argument("byte_length is not a positive multiple of chunk_size.");
+  else if (byte_offset + byte_length > commit.get_byte_length())
+    throw invalid_argument("byte range is outside of the committed data.");
+  else if (commit.get_shard_chunks() != (int) _G1.size() - 1)
+    throw invalid_argument("commit was made with a setup of a different size.");
+  
+  int shard = commit.shard_of(byte_offset);
+  if (commit.shard_of(byte_offset + byte_length - 1) != shard)
+    throw invalid_argument("byte range crosses a shard boundary.");
+  
+  uint64_t start = commit.shard_byte_offset(shard);
+  int length = min<uint64_t>((uint64_t) commit.get_shard_chunks() * chunk_size, commit.get_byte_length() - start);
+  
+  kzg::blob blob = kzg::blob::from_bytes(bytes + start, 0, length, chunk_size);
+  kzg::poly poly = kzg::poly::from_blob(blob);
+  kzg::proof proof = create_proof(poly, (byte_offset - start) / chunk_size, byte_length / chunk_size);
+  
+  std::vector<kzg::commit>& shards = commit.get_shards();
+  std::vector<std::vector<uint8_t>> tree = shard_tree(shards);
+  std::vector<std::vector<uint8_t>> path;
+  for (size_t k = tree.size() / 2 + shard; k > 1; k /= 2)
+    path.push_back(tree[k ^ 1]);
+  
+  return kzg::sharded_proof(shard, shards[shard], path, commit.get_byte_length(), chunk_size, commit.get_shard_chunks(), proof);
+}
+
+bool kzg::trusted_setup::verify_sharded_proof(const std::vector<uint8_t>& root, kzg::sharded_proof& proof, kzg::blob& expected_data) {
+  uint64_t byte_length = proof.get_byte_length();
+  int chunk_size = proof.get_chunk_size();
+  int shard_chunks = proof.get_shard_chunks();
+  if (chunk_size < 1 || shard_chunks < 1 || byte_length == 0)
+    return false;
+  
+  uint64_t shard_bytes = (uint64_t) shard_chunks * chunk_size;
+  uint64_t num_shards = (byte_length + shard_bytes - 1) / shard_bytes;
+  int shard = proof.get_shard();
+  size_t size = shard_tree_size(num_shards);
+  size_t depth = 0;
+  while (((size_t) 1 << depth) < size)
+    depth++;
+  if (shard < 0 || (uint64_t) shard >= num_shards || proof.get_path().size() != depth)
+    return false;
+  
+  // hashed up from the shard's leaf, its index picking the side at each level
+  std::vector<uint8_t> node = shard_leaf(proof.get_shard_commit());
+  size_t k = size + shard;
+  for (auto& sibling : proof.get_path()) {
+    if (sibling.size() != 32)
+      return false;
+    node = k % 2 == 0 ? shard_node(node, sibling) : shard_node(sibling, node);
+    k /= 2;
+  }
+  if (shard_root(node, byte_length, chunk_size, shard_chunks, num_shards) != root)
+    return false;
+  
+  // the points must lie inside the shard, past its end the polynomial is unconstrained
+  uint64_t start = (uint64_t) shard * shard_bytes;
+  uint64_t shard_length = min<uint64_t>(shard_bytes, byte_length - start);
+  ZZ num_chunks = conv<ZZ>((long) (shard_length / chunk_size));
+  for (auto& point : expected_data.get_data()) {
+    if (rep(point.first) >= num_chunks)
+      return false;
+  }
+  
+  return verify_proof(proof.get_shard_commit(), proof.get_proof(), expected_data);
+}
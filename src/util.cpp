@@ -1,33 +1,39 @@
+#include <kzg.h>
 #include "util.h"
+#include "field.h"
 
 #include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <random>
 #include <array>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <randapi.h>
 
-#define FAST_MULTIEVAL_THRESHOLD 140
-
-static ZZ_pX build_linear_roots_tree(
-  vector<ZZ_pX>& linear_roots,
-  vector<pair<ZZ_p, ZZ_p>>& points,
-  int lo, int hi
+static void build_linear_roots_tree(
+  kzg::workspace::state& ws,
+  int node, int lo, int hi, int threads
 );
 
-static int multieval_R(
-  vector<ZZ_p>& res,
-  const vector<ZZ_pX>& linear_roots,
+static void multieval_R(
+  ZZ_p* res,
+  kzg::workspace::state& ws,
   const ZZ_pX& f,
-  int lo, int hi, int idx
+  int node, int lo, int hi, int threads
 );
 
-static ZZ_pX polyfit_R(
-  vector<pair<ZZ_p, ZZ_p>>& points,
-  const vector<ZZ_pX>& linear_roots,
-  int lo, int hi, int& idx
+static void polyfit_R(
+  kzg::workspace::state& ws,
+  int node, int lo, int hi, int threads
 );
 
+kzg::workspace::workspace() : _state(std::make_shared<state>()) {}
+
+#ifdef KZG_NTL_SCALARS
 void BIG_from_ZZ(BIG big, const ZZ& value) {
   unsigned char data[MODBYTES_CURVE];
   BytesFromZZ(data, value, MODBYTES_CURVE);
@@ -58,6 +64,23 @@ ZZ ZZ_from_BIG(const BIG big) {
   
   return res;
 }
+#else
+void BIG_from_ZZ(BIG big, const ZZ& value) {
+  uint64_t limbs[FR_LIMBS];
+  limbs_from_ZZ(limbs, value);
+  BIG_from_limbs(big, limbs);
+}
+
+ZZ ZZ_from_BIG(const BIG big) {
+  uint64_t limbs[FR_LIMBS];
+  limbs_from_BIG(limbs, big);
+  
+  ZZ res;
+  ZZ_from_limbs(res, limbs);
+  
+  return res;
+}
+#endif
 
 void generate_random_BIG(BIG& random) {
   csprng rng;
@@ -75,6 +98,68 @@ void generate_random_BIG(BIG& random) {
   RAND_clean(&rng);
 }
 
+void transcript_append(std::vector<uint8_t>& transcript, const ZZ_p& value) {
+  uint8_t bytes[MODBYTES_CURVE];
+  BytesFromZZ(bytes, rep(value), MODBYTES_CURVE);
+  transcript.insert(transcript.end(), bytes, bytes + MODBYTES_CURVE);
+}
+
+void transcript_append(std::vector<uint8_t>& transcript, const std::string& label) {
+  transcript.insert(transcript.end(), label.begin(), label.end());
+}
+
+std::vector<uint8_t> sha256(const std::vector<uint8_t>& bytes) {
+  hash256 sh;
+  HASH256_init(&sh);
+  for (uint8_t byte : bytes)
+    HASH256_process(&sh, byte);
+  
+  char digest[32];
+  HASH256_hash(&sh, digest);
+  return std::vector<uint8_t>(digest, digest + sizeof(digest));
+}
+
+// SHA-256 over the SHA-256 of each 1MB block, so large files are hashed in
+// parallel
+void block_sha256(char* digest, const uint8_t* data, size_t size) {
+  constexpr size_t block_size = 1 << 20;
+  size_t num_blocks = (size + block_size - 1) / block_size;
+  std::vector<char> block_digests(32 * num_blocks);
+  parallel_ranges(num_blocks, [&](uint64_t begin, uint64_t end) {
+    for (uint64_t b = begin; b < end; b++) {
+      hash256 sh;
+      HASH256_init(&sh);
+      size_t block_end = std::min(size, (b + 1) * block_size);
+      for (size_t i = b * block_size; i < block_end; i++)
+        HASH256_process(&sh, data[i]);
+      HASH256_hash(&sh, &block_digests[32 * b]);
+    }
+  });
+  
+  hash256 sh;
+  HASH256_init(&sh);
+  for (char byte : block_digests)
+    HASH256_process(&sh, (uint8_t) byte);
+  HASH256_hash(&sh, digest);
+}
+
+// The base field modulus as MODBYTES_CURVE big-endian bytes, stored in file
+// and segment headers so data from a build for another curve is refused
+void curve_modulus(char* bytes) {
+  BIG modulus;
+  BIG_rcopy(modulus, Modulus);
+  BIG_toBytes(bytes, modulus);
+}
+
+// Fiat-Shamir challenge, the SHA-256 digest of the transcript reduced modulo the curve order
+ZZ_p hash_to_field(const std::vector<uint8_t>& transcript) {
+  std::vector<uint8_t> digest = sha256(transcript);
+  
+  ZZ value;
+  ZZFromBytes(value, digest.data(), digest.size());
+  return conv<ZZ_p>(value);
+}
+
 std::vector<uint8_t> serialize_ECP(const ECP& point) {
   constexpr size_t G1_OCTET_SIZE = 2 * MODBYTES_CURVE + 1;
   char buffer[G1_OCTET_SIZE];
@@ -169,116 +254,819 @@ ZZ_pX deserialize_ZZ_pX(const vector<uint8_t>& bytes) {
   return poly;
 }
 
+// Sizes the per-node storage of the workspace for a tree over n points,
+// existing elements keep their storage
+static void reserve_tree(kzg::workspace::state& ws, size_t n) {
+  if (ws.tree.size() < 4 * n) {
+    ws.tree.resize(4 * n);
+    ws.remainders.resize(4 * n);
+    ws.fits.resize(4 * n);
+    ws.products.resize(4 * n);
+  }
+  if (ws.evals.size() < n)
+    ws.evals.resize(n);
+}
+
+// Divides each value y_i by Z'(x_i) = prod_{k != i} (x_i - x_k), which is what
+// the other halves' vanishing polynomials multiply to on the way down the
+// tree, so the fits below only combine. Z' is evaluated at every point and
+// the values share one batch inversion, in fr unless NTL scalars are
+// configured so they only leave it with the quotients.
+static void divide_by_derivative(kzg::workspace::state& ws, size_t n, int threads) {
+  vector<pair<ZZ_p, ZZ_p>>& points = ws.points;
+  
+  ZZ_pX derivative;
+  diff(derivative, ws.tree[1]);
+  if ((long) n - 1 < kzg::PROFILE.fast_multieval_threshold) {
+    for (size_t i = 0; i < n; i++)
+      eval(ws.evals[i], derivative, points[i].first);
+  } else {
+    multieval_R(ws.evals.data(), ws, derivative, 1, 0, n - 1, threads);
+  }
+  
+  for (size_t i = 0; i < n; i++) {
+    if (IsZero(ws.evals[i]))
+      throw invalid_argument("points must have distinct x coordinates");
+  }
+  
+#ifdef KZG_NTL_SCALARS
+  batch_inverse(ws.evals.data(), n);
+  for (size_t i = 0; i < n; i++)
+    points[i].second *= ws.evals[i];
+#else
+  fr_vec_from_ZZ_p(ws.inverses, ws.evals.data(), n);
+  fr_batch_inv(ws.inverses, ws.inverses);
+  ws.values.resize(n);
+  for (size_t i = 0; i < n; i++)
+    fr_from_ZZ_p(ws.values[i], points[i].second);
+  fr_batch_mul(ws.values, ws.values, ws.inverses);
+  for (size_t i = 0; i < n; i++)
+    fr_to_ZZ_p(points[i].second, ws.values[i]);
+#endif
+}
+
+// Windows of consecutive points are interpolated without a tree
+void polyfit(ZZ_pX& result, const vector<pair<ZZ_p, ZZ_p>>& points, kzg::workspace::state& ws) {
+  int offset;
+  if (consecutive_window(offset, points)) {
+    interpolate_consecutive(result, points, offset, ws);
+    return;
+  }
+  
+  int threads = ws.threads > 0 ? ws.threads : kzg::PROFILE.thread_count();
+  ws.points = points;
+  reserve_tree(ws, points.size());
+  
+  build_linear_roots_tree(ws, 1, 0, points.size() - 1, threads);
+  divide_by_derivative(ws, points.size(), threads);
+  polyfit_R(ws, 1, 0, points.size() - 1, threads);
+  result = ws.fits[1];
+}
+
+void linear_roots_and_polyfit(ZZ_pX& result, ZZ_pX& linear_roots, const vector<pair<ZZ_p, ZZ_p>>& points, kzg::workspace::state& ws) {
+  int offset;
+  if (consecutive_window(offset, points)) {
+    interpolate_consecutive(result, points, offset, ws);
+    vanishing_poly(linear_roots, offset, points.size(), ws);
+    return;
+  }
+  
+  polyfit(result, points, ws);
+  linear_roots = ws.tree[1];
+}
+
 void linear_roots_and_polyfit(ZZ_pX& result, ZZ_pX& linear_roots, vector<pair<ZZ_p, ZZ_p>>& points) {
-  int idx = 0;
-  vector<pair<ZZ_p, ZZ_p>> copy = points;
-  vector<ZZ_pX> linear_roots_tree;
-  linear_roots = build_linear_roots_tree(linear_roots_tree, points, 0, points.size() - 1);
-  result = polyfit_R(copy, linear_roots_tree, 0, points.size() - 1, idx);
+  kzg::workspace::state ws;
+  linear_roots_and_polyfit(result, linear_roots, points, ws);
 }
 
 ZZ_pX polyfit(vector<pair<ZZ_p, ZZ_p>>& points) {
-  ZZ_pX fitted_poly, linear_roots;
-  linear_roots_and_polyfit(fitted_poly, linear_roots, points);
+  kzg::workspace::state ws;
+  ZZ_pX fitted_poly;
+  polyfit(fitted_poly, points, ws);
   return fitted_poly;
 }
 
 void evaluate_polynomial_points(vector<pair<ZZ_p, ZZ_p>>& points, const ZZ_pX& poly, int offset, int length) {
-  if (length < FAST_MULTIEVAL_THRESHOLD) {
+  if (length < kzg::PROFILE.fast_multieval_threshold) {
+#ifdef KZG_NTL_SCALARS
     for (int i = offset; i < offset + length; i++) {
       ZZ_p ZZ_x, ZZ_y;
       ZZ_x = i;
       ZZ_y = eval(poly, ZZ_x);
       points.push_back({ ZZ_x, ZZ_y });
     }
-  } else {
+#else
+    fr_vec coeffs;
+    fr_batch_from_ZZ_pX(coeffs, poly);
+    
     for (int i = offset; i < offset + length; i++) {
       ZZ_p ZZ_x, ZZ_y;
       ZZ_x = i;
-      ZZ_y = 0;
+      
+      fr x, y;
+      fr_from_ZZ_p(x, ZZ_x);
+      fr_horner(y, coeffs, x);
+      fr_to_ZZ_p(ZZ_y, y);
       points.push_back({ ZZ_x, ZZ_y });
     }
+#endif
+  } else {
+    vector<ZZ_p> values(length);
+    evaluate_consecutive(values.data(), poly, offset, length, kzg::PROFILE.thread_count());
     
-    vector<ZZ_pX> linear_roots_tree;
-    build_linear_roots_tree(linear_roots_tree, points, 0, points.size() - 1);
-    vector<ZZ_p> points_eval;
-    multieval_R(points_eval, linear_roots_tree, poly, 0, points.size() - 1, 0);
-    
-    for (int i = 0; i < points.size(); i++) {
-      points[i].second = points_eval[i];
+    for (int i = 0; i < length; i++) {
+      ZZ_p ZZ_x;
+      ZZ_x = offset + i;
+      points.push_back({ ZZ_x, values[i] });
     }
   }
 }
 
-static ZZ_pX polyfit_R(vector<pair<ZZ_p, ZZ_p>>& points, const vector<ZZ_pX>& linear_roots, int lo, int hi, int& idx) {
-  if (lo == hi) {
-    ZZ_pX f;
-    SetCoeff(f, 0, points[lo].second);
-    return f;
+// Z(x) = (x - offset)_length, the falling factorial shifted onto the window
+void vanishing_poly(ZZ_pX& Z, int offset, int length, kzg::workspace::state& ws) {
+  vector<ZZ_p> fact, inv_fact;
+  factorials(fact, inv_fact, length + 1);
+  falling_factorial(Z, length, fact, inv_fact);
+  
+  ZZ_p shift;
+  shift = -offset;
+  taylor_shift(Z, Z, shift, fact, inv_fact);
+}
+
+// BuildFromRoots multiplies the linear factors up a product tree, scattered
+// indices have no falling factorial to shift
+void vanishing_poly(ZZ_pX& Z, const vector<int>& indices, kzg::workspace::state& ws) {
+  ws.roots.SetLength(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    ws.roots[i] = indices[i];
+  
+  BuildFromRoots(Z, ws.roots);
+}
+
+void vanishing_poly(ZZ_pX& Z, int offset, int length) {
+  kzg::workspace::state ws;
+  vanishing_poly(Z, offset, length, ws);
+}
+
+void quotient_linear(ZZ_pX& q, const ZZ_pX& P, const ZZ_p& a, kzg::workspace::state& ws) {
+  long n = deg(P);
+  if (n < 1) {
+    clear(q);
+    return;
   }
   
-  const ZZ_pX& Z_1 = linear_roots[linear_roots.size() - idx++ - 1];
-  const ZZ_pX& Z_2 = linear_roots[linear_roots.size() - idx++ - 1];
+  // synthetic division, the remainder P(a) is never needed
+  q.SetLength(n);
+#ifdef KZG_NTL_SCALARS
+  q[n - 1] = P[n];
+  for (long i = n - 1; i > 0; i--)
+    q[i - 1] = P[i] + a * q[i];
+#else
+  fr_vec& coeffs = ws.coeffs;
+  fr_batch_from_ZZ_pX(coeffs, P);
   
-  int mid = (lo + hi) / 2;
+  fr x, t;
+  fr_from_ZZ_p(x, a);
   
-  if (mid - lo < FAST_MULTIEVAL_THRESHOLD) {
-    for (int i = lo; i <= mid; i++)
-      points[i].second /= eval(Z_2, points[i].first);
+  fr_vec& quot = ws.quot;
+  quot.resize(n);
+  quot[n - 1] = coeffs[n];
+  for (long i = n - 1; i > 0; i--) {
+    fr_mul(t, x, quot[i]);
+    fr_add(quot[i - 1], coeffs[i], t);
+  }
+  
+  for (long i = 0; i < n; i++)
+    fr_to_ZZ_p(q[i], quot[i]);
+#endif
+  q.normalize();
+}
+
+void quotient_linear(ZZ_pX& q, const ZZ_pX& P, const ZZ_p& a) {
+  kzg::workspace::state ws;
+  quotient_linear(q, P, a, ws);
+}
+
+void quotient_vanishing(ZZ_pX& q, const ZZ_pX& P, const ZZ_pX& Z, kzg::workspace::state& ws) {
+  long n = deg(P);
+  long m = deg(Z);
+  
+  if (n < m) {
+    clear(q);
+    return;
+  }
+  
+  if (m == 1) {
+    quotient_linear(q, P, -ConstTerm(Z), ws);
+  } else if (m < kzg::PROFILE.reciprocal_div_threshold) {
+    div(q, P, Z);
+  } else if (m < kzg::PROFILE.ntt_div_threshold) {
+    // Z is monic, so rev(Z) is invertible mod x^k and rev(q) = rev(P) / rev(Z) mod x^k
+    long k = n - m + 1;
+    reverse(ws.rev_Z, Z, m);
+    InvTrunc(ws.rev_Z_inv, ws.rev_Z, k);
+    reverse(ws.rev_P, P, n);
+    trunc(ws.rev_P, ws.rev_P, k);
+    MulTrunc(ws.rev_q, ws.rev_P, ws.rev_Z_inv, k);
+    reverse(q, ws.rev_q, k - 1);
   } else {
-    vector<ZZ_p> prod_eval;
-    multieval_R(prod_eval, linear_roots, Z_2, lo, mid, idx);
-    for (int i = 0; i < prod_eval.size(); i++)
-      points[lo + i].second /= prod_eval[i];
+    // the modulus precomputes the FFT representation of the reciprocal
+    build(ws.modulus, Z);
+    div(q, P, ws.modulus);
+  }
+}
+
+void quotient_vanishing(ZZ_pX& q, const ZZ_pX& P, const ZZ_pX& Z) {
+  kzg::workspace::state ws;
+  quotient_vanishing(q, P, Z, ws);
+}
+
+bool consecutive_window(int& offset, const vector<pair<ZZ_p, ZZ_p>>& points) {
+  if (points.empty())
+    throw invalid_argument("points must not be empty");
+  
+  const ZZ& start = rep(points[0].first);
+  if (NumBits(start) > 30)
+    return false;
+  
+  ZZ_p x = points[0].first;
+  for (size_t i = 1; i < points.size(); i++) {
+    x += 1;
+    if (points[i].first != x)
+      return false;
   }
-  ZZ_pX f_1 = polyfit_R(points, linear_roots, lo, mid, idx);
   
-  if (hi - (mid + 1) < FAST_MULTIEVAL_THRESHOLD) {
-    for (int i = mid + 1; i <= hi; i++)
-      points[i].second /= eval(Z_1, points[i].first);
+  offset = conv<long>(start);
+  return true;
+}
+
+// Barycentric weights 1 / prod_{k != j} (x_j - x_k) of the points offset + j,
+// which do not depend on the offset: (-1)^(length - 1 - j) / (j! (length - 1 - j)!).
+// The inverse factorials come down from a single inversion of (length - 1)!
+void window_weights(vector<ZZ_p>& weights, int length) {
+  vector<ZZ_p> factorial, inv_factorial;
+  factorials(factorial, inv_factorial, length);
+  
+  weights.resize(length);
+  for (int j = 0; j < length; j++) {
+    weights[j] = inv_factorial[j] * inv_factorial[length - 1 - j];
+    if ((length - 1 - j) % 2 == 1)
+      weights[j] = -weights[j];
+  }
+}
+
+// Lagrange interpolation over a window given its vanishing polynomial Z:
+// I = sum_j y_j w_j Z / (x - x_j)
+void interpolate_window(ZZ_pX& I, const ZZ_pX& Z, const vector<pair<ZZ_p, ZZ_p>>& points, const vector<ZZ_p>& weights, kzg::workspace::state& ws) {
+  clear(I);
+  for (size_t j = 0; j < points.size(); j++) {
+    quotient_linear(ws.q, Z, points[j].first, ws);
+    mul(ws.q, ws.q, points[j].second * weights[j]);
+    add(I, I, ws.q);
+  }
+}
+
+// Inverts every element with a single field inversion (Montgomery's trick),
+// the values must be non-zero. Code over the native field type calls
+// fr_batch_inv on its fr_vec instead.
+void batch_inverse(ZZ_p* values, size_t n) {
+  if (n == 0)
+    return;
+  
+  vector<ZZ_p> prefix(n);
+  prefix[0] = values[0];
+  for (size_t i = 1; i < n; i++)
+    prefix[i] = prefix[i - 1] * values[i];
+  
+  ZZ_p acc = inv(prefix[n - 1]);
+  for (size_t i = n - 1; i > 0; i--) {
+    ZZ_p value = values[i];
+    values[i] = acc * prefix[i - 1];
+    acc *= value;
+  }
+  values[0] = acc;
+}
+
+void batch_inverse(vector<ZZ_p>& values) {
+  batch_inverse(values.data(), values.size());
+}
+
+// Second form of the barycentric formula, y = Z(z) sum_j w_j y_j / (z - x_j).
+// Windows of consecutive points use the shift invariant factorial weights,
+// other point sets fall back to computing the weights directly. Unless NTL
+// scalars are configured the sum is taken in fr and converted once.
+void barycentric_eval(ZZ_p& y, const vector<pair<ZZ_p, ZZ_p>>& points, const ZZ_p& z) {
+  size_t n = points.size();
+  int offset;
+  bool consecutive = consecutive_window(offset, points);
+  
+#ifdef KZG_NTL_SCALARS
+  vector<ZZ_p> diffs(n);
+  ZZ_p Z_z;
+  Z_z = 1;
+  for (size_t j = 0; j < n; j++) {
+    diffs[j] = z - points[j].first;
+    if (IsZero(diffs[j])) {
+      y = points[j].second;
+      return;
+    }
+    Z_z *= diffs[j];
+  }
+  batch_inverse(diffs);
+  
+  vector<ZZ_p> weights;
+  if (consecutive) {
+    window_weights(weights, n);
   } else {
-    vector<ZZ_p> prod_eval;
-    multieval_R(prod_eval, linear_roots, Z_1, mid + 1, hi, idx);
-    for (int i = 0; i < prod_eval.size(); i++)
-      points[mid + 1 + i].second /= prod_eval[i];
+    weights.resize(n);
+    for (size_t j = 0; j < n; j++) {
+      weights[j] = 1;
+      for (size_t k = 0; k < n; k++) {
+        if (k != j)
+          weights[j] *= points[j].first - points[k].first;
+      }
+    }
+    batch_inverse(weights);
   }
-  ZZ_pX f_2 = polyfit_R(points, linear_roots, mid + 1, hi, idx);
   
-  return f_2 * Z_1 + f_1 * Z_2;
+  ZZ_p sum;
+  clear(sum);
+  for (size_t j = 0; j < n; j++)
+    sum += weights[j] * points[j].second * diffs[j];
+  
+  y = Z_z * sum;
+#else
+  fr_vec xs(n), ys(n), diffs(n), weights;
+  fr fz, Z_z, t;
+  fr_from_ZZ_p(fz, z);
+  Z_z = FR.one;
+  for (size_t j = 0; j < n; j++) {
+    fr_from_ZZ_p(xs[j], points[j].first);
+    fr_sub(diffs[j], fz, xs[j]);
+    if (fr_is_zero(diffs[j])) {
+      y = points[j].second;
+      return;
+    }
+    fr_from_ZZ_p(ys[j], points[j].second);
+    fr_mul(Z_z, Z_z, diffs[j]);
+  }
+  fr_batch_inv(diffs, diffs);
+  
+  if (consecutive) {
+    vector<ZZ_p> factorial_weights;
+    window_weights(factorial_weights, n);
+    fr_vec_from_ZZ_p(weights, factorial_weights.data(), n);
+  } else {
+    weights.resize(n);
+    for (size_t j = 0; j < n; j++) {
+      weights[j] = FR.one;
+      for (size_t k = 0; k < n; k++) {
+        if (k != j) {
+          fr_sub(t, xs[j], xs[k]);
+          fr_mul(weights[j], weights[j], t);
+        }
+      }
+    }
+    fr_batch_inv(weights, weights);
+  }
+  
+  fr_batch_mul(weights, weights, ys);
+  fr_batch_mul(weights, weights, diffs);
+  fr_sum(t, weights);
+  fr_mul(t, t, Z_z);
+  fr_to_ZZ_p(y, t);
+#endif
+}
+
+// Runs f(begin, end) over contiguous slices of [0, n) on the profile's threads.
+// Workers do not install the ZZ_p modulus, f is expected to use native types.
+void parallel_ranges(uint64_t n, const std::function<void(uint64_t, uint64_t)>& f) {
+  uint64_t num_threads = std::min<uint64_t>(kzg::PROFILE.thread_count(), n);
+  if (num_threads <= 1) {
+    f(0, n);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  for (uint64_t t = 0; t < num_threads; t++) {
+    uint64_t begin = n * t / num_threads;
+    uint64_t end = n * (t + 1) / num_threads;
+    threads.push_back(std::thread([&, begin, end]() {
+      try {
+        f(begin, end);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error = std::current_exception();
+      }
+    }));
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Runs left and right as a fork/join pair, left on a worker thread if fork is
+// set. The ZZ_p modulus is thread local, so the worker installs the caller's.
+template <typename L, typename R>
+static void fork_join(bool fork, const L& left, const R& right) {
+  if (!fork) {
+    left();
+    right();
+    return;
+  }
+  
+  ZZ_pContext context;
+  context.save();
+  
+  std::exception_ptr left_error, right_error;
+  std::thread worker([&]() {
+    context.restore();
+    try { left(); }
+    catch (...) { left_error = std::current_exception(); }
+  });
+  
+  try { right(); }
+  catch (...) { right_error = std::current_exception(); }
+  worker.join();
+  
+  if (left_error)
+    std::rethrow_exception(left_error);
+  if (right_error)
+    std::rethrow_exception(right_error);
+}
+
+static bool should_fork(int threads, int size) {
+  return threads > 1 && size >= kzg::PROFILE.parallel_grain;
 }
 
-static int multieval_R(vector<ZZ_p>& res, const vector<ZZ_pX>& linear_roots, const ZZ_pX& f, int lo, int hi, int idx) {
+// Karatsuba step with the three half-size products computed concurrently,
+// used for the large products near the root of the tree.
+static void parallel_mul(ZZ_pX& x, const ZZ_pX& a, const ZZ_pX& b, int threads) {
+  long n = max(deg(a), deg(b)) + 1;
+  if (threads < 3 || n < 2 * kzg::PROFILE.parallel_grain) {
+    mul(x, a, b);
+    return;
+  }
+  
+  long h = n / 2;
+  ZZ_pX a_lo, a_hi, b_lo, b_hi;
+  trunc(a_lo, a, h);
+  RightShift(a_hi, a, h);
+  trunc(b_lo, b, h);
+  RightShift(b_hi, b, h);
+  ZZ_pX a_sum = a_lo + a_hi, b_sum = b_lo + b_hi;
+  
+  ZZ_pX lo, hi, mid;
+  int t = threads / 3;
+  fork_join(true,
+    [&]() { parallel_mul(lo, a_lo, b_lo, t); },
+    [&]() {
+      fork_join(true,
+        [&]() { parallel_mul(hi, a_hi, b_hi, t); },
+        [&]() { parallel_mul(mid, a_sum, b_sum, threads - 2 * t); });
+    });
+  
+  mid -= lo;
+  mid -= hi;
+  LeftShift(mid, mid, h);
+  LeftShift(hi, hi, 2 * h);
+  add(x, lo, mid);
+  add(x, x, hi);
+}
+
+// The tree is stored heap style, node k covers points[lo..hi] and its children
+// 2k and 2k + 1 cover points[lo..mid] and points[mid + 1..hi]. Every
+// intermediate result lives in the workspace under the index of its node.
+static void polyfit_R(kzg::workspace::state& ws, int node, int lo, int hi, int threads) {
+  vector<pair<ZZ_p, ZZ_p>>& points = ws.points;
+  
   if (lo == hi) {
-    res.push_back(f[0]);
-    return idx;
+    clear(ws.fits[node]);
+    SetCoeff(ws.fits[node], 0, points[lo].second);
+    return;
   }
   
-  const ZZ_pX& Z_1 = linear_roots[linear_roots.size() - idx++ - 1];
-  const ZZ_pX& Z_2 = linear_roots[linear_roots.size() - idx++ - 1];
+  const ZZ_pX& Z_1 = ws.tree[2 * node];
+  const ZZ_pX& Z_2 = ws.tree[2 * node + 1];
   
-  ZZ_pX f_1 = f % Z_1;
-  ZZ_pX f_2 = f % Z_2;
+  int mid = (lo + hi) / 2;
+  bool fork = should_fork(threads, hi - lo + 1);
+  int left_threads = fork ? threads / 2 : threads;
+  int right_threads = fork ? threads - threads / 2 : threads;
+  
+  // values were divided by Z' up front, so the halves are fitted as they are
+  fork_join(fork,
+    [&]() { polyfit_R(ws, 2 * node, lo, mid, left_threads); },
+    [&]() { polyfit_R(ws, 2 * node + 1, mid + 1, hi, right_threads); });
+  
+  fork_join(fork,
+    [&]() { parallel_mul(ws.products[2 * node], ws.fits[2 * node + 1], Z_1, left_threads); },
+    [&]() { parallel_mul(ws.products[2 * node + 1], ws.fits[2 * node], Z_2, right_threads); });
+  
+  add(ws.fits[node], ws.products[2 * node], ws.products[2 * node + 1]);
+}
+
+static void multieval_R(ZZ_p* res, kzg::workspace::state& ws, const ZZ_pX& f, int node, int lo, int hi, int threads) {
+  if (lo == hi) {
+    res[0] = coeff(f, 0);
+    return;
+  }
   
   int mid = (lo + hi) / 2;
-  idx = multieval_R(res, linear_roots, f_1, lo, mid, idx);
-  idx = multieval_R(res, linear_roots, f_2, mid + 1, hi, idx);
+  bool fork = should_fork(threads, hi - lo + 1);
+  int left_threads = fork ? threads / 2 : threads;
+  int right_threads = fork ? threads - threads / 2 : threads;
   
-  return idx;
+  fork_join(fork,
+    [&]() {
+      rem(ws.remainders[2 * node], f, ws.tree[2 * node]);
+      multieval_R(res, ws, ws.remainders[2 * node], 2 * node, lo, mid, left_threads);
+    },
+    [&]() {
+      rem(ws.remainders[2 * node + 1], f, ws.tree[2 * node + 1]);
+      multieval_R(res + (mid + 1 - lo), ws, ws.remainders[2 * node + 1], 2 * node + 1, mid + 1, hi, right_threads);
+    });
 }
 
-static ZZ_pX build_linear_roots_tree(vector<ZZ_pX>& linear_roots, vector<pair<ZZ_p, ZZ_p>>& points, int lo, int hi) {
+static void build_linear_roots_tree(kzg::workspace::state& ws, int node, int lo, int hi, int threads) {
   if (lo == hi) {
-    ZZ_pX linear_root;
-    SetCoeff(linear_root, 0, -points[lo].first);
-    SetCoeff(linear_root, 1, 1);
-    return linear_root;
+    clear(ws.tree[node]);
+    SetCoeff(ws.tree[node], 0, -ws.points[lo].first);
+    SetCoeff(ws.tree[node], 1, 1);
+    return;
   }
   
   int mid = (lo + hi) / 2;
-  ZZ_pX Z_2 = build_linear_roots_tree(linear_roots, points, mid + 1, hi);
-  ZZ_pX Z_1 = build_linear_roots_tree(linear_roots, points, lo, mid);
-  linear_roots.push_back(Z_2);
-  linear_roots.push_back(Z_1);
+  bool fork = should_fork(threads, hi - lo + 1);
+  int left_threads = fork ? threads / 2 : threads;
+  int right_threads = fork ? threads - threads / 2 : threads;
+  
+  fork_join(fork,
+    [&]() { build_linear_roots_tree(ws, 2 * node, lo, mid, left_threads); },
+    [&]() { build_linear_roots_tree(ws, 2 * node + 1, mid + 1, hi, right_threads); });
+  
+  parallel_mul(ws.tree[node], ws.tree[2 * node], ws.tree[2 * node + 1], threads);
+}
+
+// Windows of consecutive points x = offset + j. Everything is done relative to
+// the nodes 0..n-1 and moved to the offset with one Taylor shift, so no tree of
+// linear factors is built: the products involved are falling factorials
+// (y)_k = y (y - 1) ... (y - k + 1), which double by shifting, and the
+// interpolant has closed form coefficients in the falling factorial basis.
+
+// Blocks up to this size convert between bases with quadratic Horner loops
+static const long FALLING_BASE = 32;
+
+// fact[i] = i! and inv_fact[i] = 1 / i! for i < n with a single inversion
+void factorials(vector<ZZ_p>& fact, vector<ZZ_p>& inv_fact, long n) {
+  fact.resize(n);
+  inv_fact.resize(n);
+  fact[0] = 1;
+  for (long i = 1; i < n; i++)
+    fact[i] = fact[i - 1] * i;
+  inv_fact[n - 1] = inv(fact[n - 1]);
+  for (long i = n - 1; i > 0; i--)
+    inv_fact[i - 1] = inv_fact[i] * i;
+}
+
+// Q(x) = P(x + a) as one product, k! q_k = sum_i (i! p_i) a^(i - k) / (i - k)!
+void taylor_shift(ZZ_pX& Q, const ZZ_pX& P, const ZZ_p& a, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact) {
+  long d = deg(P);
+  if (d < 1 || IsZero(a)) {
+    Q = P;
+    return;
+  }
+  
+  ZZ_pX A, B, C;
+  A.SetLength(d + 1);
+  B.SetLength(d + 1);
+  ZZ_p power;
+  power = 1;
+  for (long i = 0; i <= d; i++) {
+    A[d - i] = P[i] * fact[i];
+    B[i] = power * inv_fact[i];
+    power *= a;
+  }
+  A.normalize();
+  MulTrunc(C, A, B, d + 1);
+  
+  Q.SetLength(d + 1);
+  for (long k = 0; k <= d; k++)
+    Q[k] = coeff(C, d - k) * inv_fact[k];
+  Q.normalize();
+}
+
+// g *= (y - k)
+static void mul_falling_step(ZZ_pX& g, long k) {
+  long d = deg(g);
+  if (d < 0)
+    return;
+  
+  ZZ_p c;
+  c = k;
+  g.SetLength(d + 2);
+  g[d + 1] = g[d];
+  for (long i = d; i > 0; i--)
+    g[i] = g[i - 1] - c * g[i];
+  g[0] = -c * g[0];
+}
+
+// (y)_n from the top bit down, (y)_2m = (y)_m (y - m)_m and (y)_m+1 = (y)_m (y - m)
+void falling_factorial(ZZ_pX& F, long n, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact) {
+  set(F);
+  ZZ_pX shifted;
+  long m = 0;
+  for (long bit = NumBits(n) - 1; bit >= 0; bit--) {
+    if (m > 0) {
+      ZZ_p a;
+      a = -m;
+      taylor_shift(shifted, F, a, fact, inv_fact);
+      mul(F, F, shifted);
+      m *= 2;
+    }
+    if ((n >> bit) & 1) {
+      mul_falling_step(F, m);
+      m++;
+    }
+  }
+}
+
+// falling[l] = (y)_(2^l) for the power of two block sizes below size
+static void falling_table(vector<ZZ_pX>& falling, long size, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact) {
+  falling.clear();
+  ZZ_pX shifted;
+  for (long m = 1; m < size; m *= 2) {
+    falling.emplace_back();
+    if (m == 1) {
+      SetX(falling.back());
+      continue;
+    }
+    
+    ZZ_pX& half = falling[falling.size() - 2];
+    ZZ_p a;
+    a = -m / 2;
+    taylor_shift(shifted, half, a, fact, inv_fact);
+    mul(falling.back(), half, shifted);
+  }
+}
+
+// g = sum_k a_k (y)_k for k < len, len a power of two. The upper half is
+// (y)_h sum_k a_(h + k) (y - h)_k, a shift of the same problem of half the size.
+static void from_falling(ZZ_pX& g, const ZZ_p* a, long len, const vector<ZZ_pX>& falling, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact, int threads) {
+  if (len <= FALLING_BASE) {
+    clear(g);
+    for (long k = len - 1; k >= 0; k--) {
+      mul_falling_step(g, k);
+      SetCoeff(g, 0, coeff(g, 0) + a[k]);
+    }
+    return;
+  }
+  
+  long half = len / 2;
+  bool fork = should_fork(threads, len);
+  int left_threads = fork ? threads / 2 : threads;
+  int right_threads = fork ? threads - threads / 2 : threads;
+  
+  ZZ_pX lo, hi;
+  fork_join(fork,
+    [&]() { from_falling(lo, a, half, falling, fact, inv_fact, left_threads); },
+    [&]() {
+      from_falling(hi, a + half, half, falling, fact, inv_fact, right_threads);
+      ZZ_p shift;
+      shift = -half;
+      taylor_shift(hi, hi, shift, fact, inv_fact);
+    });
+  
+  parallel_mul(hi, hi, falling[NumBits(half) - 1], threads);
+  add(g, lo, hi);
+}
+
+// The inverse of from_falling for deg(h) < len: h = r + (y)_h q with q in the
+// basis (y - h)_k, so q is shifted by h and converted like the lower half.
+static void to_falling(ZZ_p* b, const ZZ_pX& h, long len, const vector<ZZ_pXModulus>& moduli, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact, int threads) {
+  if (len <= FALLING_BASE) {
+    // b_k is the remainder of the k-th quotient by (y - k)
+    ZZ_pX r = h;
+    for (long k = 0; k < len; k++) {
+      long d = deg(r);
+      if (d < 0) {
+        clear(b[k]);
+        continue;
+      }
+      
+      ZZ_p c;
+      c = k;
+      for (long i = d; i > 0; i--)
+        r[i - 1] += c * r[i];
+      b[k] = r[0];
+      RightShift(r, r, 1);
+    }
+    return;
+  }
+  
+  long half = len / 2;
+  ZZ_pX q, r;
+  DivRem(q, r, h, moduli[NumBits(half) - 1]);
+  
+  bool fork = should_fork(threads, len);
+  int left_threads = fork ? threads / 2 : threads;
+  int right_threads = fork ? threads - threads / 2 : threads;
+  
+  fork_join(fork,
+    [&]() { to_falling(b, r, half, moduli, fact, inv_fact, left_threads); },
+    [&]() {
+      ZZ_p shift;
+      shift = half;
+      taylor_shift(q, q, shift, fact, inv_fact);
+      to_falling(b + half, q, half, moduli, fact, inv_fact, right_threads);
+    });
+}
+
+// Newton interpolation over offset + j: the coefficients in the falling
+// factorial basis are the forward differences a_k = sum_j y_j (-1)^(k - j) / (j! (k - j)!),
+// one product with the inverse factorials
+void interpolate_consecutive(ZZ_pX& I, const vector<pair<ZZ_p, ZZ_p>>& points, int offset, kzg::workspace::state& ws) {
+  int threads = ws.threads > 0 ? ws.threads : kzg::PROFILE.thread_count();
+  long n = points.size();
+  long size = 1;
+  while (size < n)
+    size *= 2;
+  
+  vector<ZZ_p> fact, inv_fact;
+  factorials(fact, inv_fact, size + 1);
+  
+  ZZ_pX Y, E, N;
+  Y.SetLength(n);
+  E.SetLength(n);
+  for (long j = 0; j < n; j++) {
+    Y[j] = points[j].second * inv_fact[j];
+    E[j] = j % 2 == 0 ? inv_fact[j] : -inv_fact[j];
+  }
+  Y.normalize();
+  MulTrunc(N, Y, E, n);
+  
+  vector<ZZ_p> a(size);
+  for (long k = 0; k < n; k++)
+    a[k] = coeff(N, k);
+  
+  vector<ZZ_pX> falling;
+  falling_table(falling, size, fact, inv_fact);
+  from_falling(I, a.data(), size, falling, fact, inv_fact, threads);
+  
+  ZZ_p shift;
+  shift = -offset;
+  taylor_shift(I, I, shift, fact, inv_fact);
+}
+
+// Evaluates P at offset + j for j < length. With h(y) = P(y + offset) in the
+// falling factorial basis, h(j) / j! = sum_k b_k / (j - k)! is one product.
+void evaluate_consecutive(ZZ_p* values, const ZZ_pX& P, int offset, int length, int threads) {
+  long d = deg(P);
+  if (d < 0) {
+    for (int j = 0; j < length; j++)
+      clear(values[j]);
+    return;
+  }
+  
+  long size = 1;
+  while (size < d + 1)
+    size *= 2;
+  
+  vector<ZZ_p> fact, inv_fact;
+  factorials(fact, inv_fact, max<long>(size, length) + 1);
+  
+  ZZ_pX h;
+  ZZ_p shift;
+  shift = offset;
+  taylor_shift(h, P, shift, fact, inv_fact);
+  
+  vector<ZZ_pX> falling;
+  falling_table(falling, size, fact, inv_fact);
+  vector<ZZ_pXModulus> moduli(falling.size());
+  for (size_t l = 0; l < falling.size(); l++) {
+    if ((1L << l) >= FALLING_BASE)
+      build(moduli[l], falling[l]);
+  }
+  
+  vector<ZZ_p> b(size);
+  to_falling(b.data(), h, size, moduli, fact, inv_fact, threads);
+  
+  long terms = min<long>(d + 1, length);
+  ZZ_pX B, E, V;
+  B.SetLength(terms);
+  for (long k = 0; k < terms; k++)
+    B[k] = b[k];
+  B.normalize();
+  E.SetLength(length);
+  for (long i = 0; i < length; i++)
+    E[i] = inv_fact[i];
+  MulTrunc(V, B, E, length);
   
-  return Z_1 * Z_2;
+  for (long j = 0; j < length; j++)
+    values[j] = coeff(V, j) * fact[j];
 }
@@ -1,19 +1,75 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <NTL/ZZX.h>
-#include <kzg_config.h>
+#include <NTL/ZZ_pX.h>
+#include <kzg.h>
+#include "field.h"
 
 using namespace std;
 using namespace NTL;
 
+// Scratch objects reused across calls through a kzg::workspace. NTL keeps the
+// storage of vectors and polynomials when they are assigned again, so a
+// workspace that has seen a problem size does not allocate for it again.
+struct kzg::workspace::state {
+  // interpolation and multipoint evaluation, indexed by subproduct tree node
+  vector<pair<ZZ_p, ZZ_p>> points;
+  vector<ZZ_pX> tree;
+  vector<ZZ_pX> remainders;
+  vector<ZZ_pX> fits;
+  vector<ZZ_pX> products;
+  vector<ZZ_p> evals;
+  
+  // proof quotients
+  vec_ZZ_p roots;
+  ZZ_pX Z, q, rev_P, rev_Z, rev_Z_inv, rev_q;
+  ZZ_pXModulus modulus;
+  fr_vec coeffs, quot, inverses, values;
+  
+  // curve scalars for multi-scalar multiplication
+  vector<BIG> scalars;
+  
+  // thread budget for the subproduct tree, 0 uses the profile's thread count
+  int threads = 0;
+};
+
 void BIG_from_ZZ(BIG big, const ZZ& value);
 ZZ ZZ_from_BIG(const BIG big);
 ZZ_pX polyfit(vector<pair<ZZ_p, ZZ_p>>& points);
+void polyfit(ZZ_pX& result, const vector<pair<ZZ_p, ZZ_p>>& points, kzg::workspace::state& ws);
 void linear_roots_and_polyfit(ZZ_pX& result, ZZ_pX& linear_roots, vector<pair<ZZ_p, ZZ_p>>& points);
+void linear_roots_and_polyfit(ZZ_pX& result, ZZ_pX& linear_roots, const vector<pair<ZZ_p, ZZ_p>>& points, kzg::workspace::state& ws);
 void evaluate_polynomial_points(vector<pair<ZZ_p, ZZ_p>>& points, const ZZ_pX& poly, int start, int length);
+void vanishing_poly(ZZ_pX& Z, int offset, int length);
+void vanishing_poly(ZZ_pX& Z, int offset, int length, kzg::workspace::state& ws);
+void vanishing_poly(ZZ_pX& Z, const vector<int>& indices, kzg::workspace::state& ws);
+void quotient_linear(ZZ_pX& q, const ZZ_pX& P, const ZZ_p& a);
+void quotient_linear(ZZ_pX& q, const ZZ_pX& P, const ZZ_p& a, kzg::workspace::state& ws);
+void quotient_vanishing(ZZ_pX& q, const ZZ_pX& P, const ZZ_pX& Z);
+void quotient_vanishing(ZZ_pX& q, const ZZ_pX& P, const ZZ_pX& Z, kzg::workspace::state& ws);
+bool consecutive_window(int& offset, const vector<pair<ZZ_p, ZZ_p>>& points);
+void window_weights(vector<ZZ_p>& weights, int length);
+void batch_inverse(vector<ZZ_p>& values);
+void batch_inverse(ZZ_p* values, size_t n);
+void barycentric_eval(ZZ_p& y, const vector<pair<ZZ_p, ZZ_p>>& points, const ZZ_p& z);
+void interpolate_window(ZZ_pX& I, const ZZ_pX& Z, const vector<pair<ZZ_p, ZZ_p>>& points, const vector<ZZ_p>& weights, kzg::workspace::state& ws);
+void factorials(vector<ZZ_p>& fact, vector<ZZ_p>& inv_fact, long n);
+void taylor_shift(ZZ_pX& Q, const ZZ_pX& P, const ZZ_p& a, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact);
+void falling_factorial(ZZ_pX& F, long n, const vector<ZZ_p>& fact, const vector<ZZ_p>& inv_fact);
+void interpolate_consecutive(ZZ_pX& I, const vector<pair<ZZ_p, ZZ_p>>& points, int offset, kzg::workspace::state& ws);
+void evaluate_consecutive(ZZ_p* values, const ZZ_pX& P, int offset, int length, int threads);
 void generate_random_BIG(BIG& random);
+void parallel_ranges(uint64_t n, const std::function<void(uint64_t, uint64_t)>& f);
+void transcript_append(std::vector<uint8_t>& transcript, const ZZ_p& value);
+void transcript_append(std::vector<uint8_t>& transcript, const std::string& label);
+std::vector<uint8_t> sha256(const std::vector<uint8_t>& bytes);
+void block_sha256(char* digest, const uint8_t* data, size_t size);
+void curve_modulus(char* bytes);
+ZZ_p hash_to_field(const std::vector<uint8_t>& transcript);
 std::vector<uint8_t> serialize_ECP(const ECP& point);
 ECP deserialize_ECP(const std::vector<uint8_t>& bytes);
 std::vector<uint8_t> serialize_ZZ_pX(const ZZ_pX& poly);
@@ -1,4 +1,6 @@
 #include "kzg.h"
+#include "field.h"
+#include "util.h"
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -8,9 +10,14 @@
 #include <utility>
 #include <ctime>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <iterator>
 #include <vector>
 #include <sstream>
 #include <fstream>
+#include <climits>
+#include <algorithm>
 
 void check_test(bool status, string test_name);
 void example_test();
@@ -24,6 +31,31 @@ void poly_degree_10_test();
 void high_poly_degree_test();
 void chunking_test();
 void chunking_invalid_args_test();
+void quotient_window_test();
+void profile_test();
+void parallel_tree_test();
+void verify_cache_test();
+void workspace_test();
+void opening_test();
+void batch_opening_test();
+void sparse_proof_test();
+void sharded_commit_test();
+void setup_file_test();
+void setup_resume_test();
+void eip4844_test();
+void eip4844_mainnet_test();
+void shared_setup_test();
+void verify_proofs_test();
+void poly_cache_test();
+void extension_test();
+void vartime_test();
+void packed_blob_test();
+void create_commits_test();
+void precompute_test();
+void psi_msm_test();
+void batch_inverse_test();
+void consecutive_domain_test();
+void field_test();
 void general_test(int num_coeff, string data, vector<pair<int, int>> to_verify, vector<tuple<int, int, string>> to_refute, bool to_serialize);
 vector<uint8_t> from_hex(string s);
 string random_string(const int len);
@@ -47,6 +79,31 @@ int main() {
   chunking_test();
   chunking_invalid_args_test();
   random_test(9, 140, 1, true);
+  quotient_window_test();
+  profile_test();
+  parallel_tree_test();
+  verify_cache_test();
+  workspace_test();
+  opening_test();
+  batch_opening_test();
+  sparse_proof_test();
+  sharded_commit_test();
+  setup_file_test();
+  setup_resume_test();
+  eip4844_test();
+  eip4844_mainnet_test();
+  shared_setup_test();
+  verify_proofs_test();
+  poly_cache_test();
+  extension_test();
+  vartime_test();
+  packed_blob_test();
+  create_commits_test();
+  precompute_test();
+  psi_msm_test();
+  batch_inverse_test();
+  consecutive_domain_test();
+  field_test();
   eth_blob_test();
 }
 
@@ -61,11 +118,7 @@ void eth_blob_test() {
   blob1_buffer << blob1_file.rdbuf();
   vector<uint8_t> blob1_bytes = from_hex(blob1_buffer.str());
   
-  int zero_pad = MAX_CHUNK_BYTES - (blob1_bytes.size() % MAX_CHUNK_BYTES);
-  for (int i = 0; i < zero_pad; i++)
-    blob1_bytes.push_back(0);
-  
-  kzg::blob blob = kzg::blob::from_bytes(blob1_bytes.data(), 0, blob1_bytes.size(), MAX_CHUNK_BYTES);
+  kzg::blob blob = kzg::blob::from_bytes_packed(blob1_bytes.data(), blob1_bytes.size());
   kzg::poly poly = kzg::poly::from_blob(blob);
   kzg::commit commit = kzg.create_commit(poly);
   check_test(kzg.verify_commit(commit, poly), "eth-blob, commit verification for blob1");
@@ -85,11 +138,7 @@ void eth_blob_test() {
   blob2_buffer << blob2_file.rdbuf();
   vector<uint8_t> blob2_bytes = from_hex(blob2_buffer.str());
   
-  zero_pad = MAX_CHUNK_BYTES - (blob2_bytes.size() % MAX_CHUNK_BYTES);
-  for (int i = 0; i < zero_pad; i++)
-    blob2_bytes.push_back(0);
-  
-  blob = kzg::blob::from_bytes(blob2_bytes.data(), 0, blob2_bytes.size(), MAX_CHUNK_BYTES);
+  blob = kzg::blob::from_bytes_packed(blob2_bytes.data(), blob2_bytes.size());
   poly = kzg::poly::from_blob(blob);
   commit = kzg.create_commit(poly);
   check_test(kzg.verify_commit(commit, poly), "eth-blob, commit verification for blob2");
@@ -310,6 +359,1032 @@ void chunking_invalid_args_test() {
   check_test(exception, "chunking invalid args, invalid byte offset");
 }
 
+void quotient_window_test() {
+  kzg::trusted_setup kzg(2100);
+  string data = random_string(2000);
+  kzg::blob blob = kzg::blob::from_string(data);
+  kzg::poly poly = kzg::poly::from_blob(blob);
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  // window lengths chosen to exercise each division strategy
+  vector<pair<int, int>> windows = { {7, 1}, {100, 4}, {300, 80}, {500, 1100} };
+  for (auto w : windows) {
+    kzg::proof proof = kzg.create_proof(poly, w.first, w.second);
+    kzg::blob verify = kzg::blob::from_string(data.substr(w.first, w.second), w.first);
+    check_test(kzg.verify_proof(commit, proof, verify), "quotient, proof verification for window of " + to_string(w.second));
+  }
+  
+  kzg::proof proof = kzg.create_proof(poly, 300, 80);
+  kzg::blob refute = kzg::blob::from_string(data.substr(301, 80), 300);
+  check_test(!kzg.verify_proof(commit, proof, refute), "quotient, proof refutation for window of 80");
+}
+
+void profile_test() {
+  kzg::profile profile;
+  profile.fast_multieval_threshold = 200;
+  profile.msm_g1_threshold = 1;
+  profile.msm_window_offset = 3;
+  profile.num_threads = 2;
+  profile.save("test_profile");
+  
+  kzg::profile loaded = kzg::profile::load("test_profile");
+  check_test(loaded.fast_multieval_threshold == 200 && loaded.msm_g1_threshold == 1 &&
+             loaded.msm_window_offset == 3 && loaded.num_threads == 2, "profile, save and load");
+  
+  // the bucket method must agree with per-term multiplication
+  kzg::profile saved = kzg::PROFILE;
+  kzg::trusted_setup kzg(300);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(random_string(250)));
+  kzg::PROFILE.msm_g1_threshold = INT_MAX;
+  kzg::commit naive = kzg.create_commit(poly);
+  kzg::PROFILE = loaded;
+  kzg::commit bucket = kzg.create_commit(poly);
+  kzg::PROFILE = saved;
+  check_test(ECP_equals(&naive.get_curve_point(), &bucket.get_curve_point()), "profile, bucket commit matches naive commit");
+  
+  bool exception = false;
+  try { kzg::profile::load("missing_profile"); }
+  catch (...) { exception = true; }
+  check_test(exception, "profile, missing file is invalid");
+  
+  kzg::profile().save("test_profile");
+  bool defaults = kzg::profile::load("test_profile").num_threads == 0;
+  
+  bool rejected = true;
+  for (string line : { "num_threads 0", "msm_window_offset -1", "msm_window_offset 40", "msm_g1_threshold -5", "parallel_grain 0" }) {
+    ofstream file("test_profile", ios::trunc);
+    file << line << endl;
+    file.close();
+    
+    bool thrown = false;
+    try { kzg::profile::load("test_profile"); }
+    catch (const runtime_error& e) { thrown = true; }
+    rejected = rejected && thrown;
+  }
+  remove("test_profile");
+  check_test(defaults && rejected, "profile, out of range values are rejected");
+}
+
+void parallel_tree_test() {
+  kzg::profile saved = kzg::PROFILE;
+  kzg::blob blob = kzg::blob::from_string(random_string(3000));
+  
+  kzg::PROFILE.num_threads = 1;
+  kzg::poly sequential = kzg::poly::from_blob(blob);
+  
+  kzg::PROFILE.num_threads = 6;
+  kzg::PROFILE.parallel_grain = 16;
+  kzg::poly parallel = kzg::poly::from_blob(blob);
+  kzg::PROFILE = saved;
+  
+  check_test(sequential.get_poly() == parallel.get_poly(), "parallel tree, interpolation matches sequential");
+  
+  bool match = true;
+  for (auto& point : blob.get_data())
+    match = match && eval(parallel.get_poly(), point.first) == point.second;
+  check_test(match, "parallel tree, interpolation fits every point");
+}
+
+void verify_cache_test() {
+  kzg::trusted_setup kzg(300);
+  string data = random_string(256);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(data));
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  // repeated and shifted 4 chunk windows share cached state
+  bool verified = true;
+  for (int offset : { 0, 8, 0, 100, 8, 252 }) {
+    kzg::proof proof = kzg.create_proof(poly, offset, 4);
+    kzg::blob verify = kzg::blob::from_string(data.substr(offset, 4), offset);
+    verified = verified && kzg.verify_proof(commit, proof, verify);
+  }
+  check_test(verified, "verify cache, repeated and shifted windows");
+  
+  kzg::proof proof = kzg.create_proof(poly, 8, 4);
+  string tampered = data.substr(8, 4);
+  tampered[2] ^= 1;
+  kzg::blob refute = kzg::blob::from_string(tampered, 8);
+  check_test(!kzg.verify_proof(commit, proof, refute), "verify cache, refutation of a cached window");
+  
+  kzg::blob shifted = kzg::blob::from_string(data.substr(8, 4), 9);
+  check_test(!kzg.verify_proof(commit, proof, shifted), "verify cache, refutation of a shifted window");
+}
+
+void workspace_test() {
+  kzg::trusted_setup kzg(600);
+  kzg::workspace workspace;
+  
+  // a shrinking then growing problem size must not see stale temporaries
+  bool fitted = true, verified = true;
+  for (int length : { 500, 40, 300 }) {
+    string data = random_string(length);
+    kzg::blob blob = kzg::blob::from_string(data);
+    kzg::poly poly = kzg::poly::from_blob(blob, workspace);
+    fitted = fitted && poly.get_poly() == kzg::poly::from_blob(blob).get_poly();
+    
+    kzg::commit commit = kzg.create_commit(poly);
+    for (auto w : vector<pair<int, int>>{ {0, 1}, {3, 20}, {length / 4, length / 2} }) {
+      kzg::proof proof = kzg.create_proof(poly, w.first, w.second, workspace);
+      kzg::blob verify = kzg::blob::from_string(data.substr(w.first, w.second), w.first);
+      verified = verified && kzg.verify_proof(commit, proof, verify, workspace);
+    }
+  }
+  
+  check_test(fitted, "workspace, interpolation matches");
+  check_test(verified, "workspace, proof verification");
+}
+
+void opening_test() {
+  kzg::trusted_setup kzg(300);
+  string data = random_string(200);
+  kzg::blob blob = kzg::blob::from_string(data);
+  kzg::poly poly = kzg::poly::from_blob(blob);
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  ZZ_p z = random_ZZ_p();
+  auto opening = kzg.create_opening(poly, z);
+  check_test(kzg.verify_opening(commit, opening.second, z, opening.first), "opening, verification at a random point");
+  check_test(blob.evaluate(z) == opening.first, "opening, barycentric evaluation matches");
+  check_test(!kzg.verify_opening(commit, opening.second, z, opening.first + 1), "opening, refutation of a wrong value");
+  check_test(!kzg.verify_opening(commit, opening.second, z + 1, opening.first), "opening, refutation of a wrong point");
+  
+  ZZ_p x;
+  x = 17;
+  check_test(blob.evaluate(x) == blob.get_data()[17].second, "opening, barycentric evaluation on the domain");
+  
+  // scattered points use directly computed weights
+  vector<pair<ZZ_p, ZZ_p>> points;
+  for (int i = 0; i < 20; i++) {
+    ZZ_p point_x;
+    point_x = 3 * i * i + 1;
+    points.push_back({ point_x, random_ZZ_p() });
+  }
+  kzg::blob scattered(points);
+  kzg::poly scattered_poly = kzg::poly::from_blob(scattered);
+  check_test(scattered.evaluate(z) == eval(scattered_poly.get_poly(), z), "opening, barycentric evaluation on scattered points");
+}
+
+void batch_opening_test() {
+  kzg::trusted_setup kzg(200);
+  vector<kzg::poly> polys;
+  vector<kzg::commit> commits;
+  for (int length : { 150, 3, 80, 1, 120 }) {
+    polys.push_back(kzg::poly::from_blob(kzg::blob::from_string(random_string(length))));
+    commits.push_back(kzg.create_commit(polys.back()));
+  }
+  
+  ZZ_p z = random_ZZ_p();
+  auto opening = kzg.create_batch_opening(polys, commits, z);
+  check_test(kzg.verify_batch_opening(commits, opening.second, z, opening.first), "batch opening, verification");
+  
+  bool evaluations = true;
+  for (size_t i = 0; i < polys.size(); i++)
+    evaluations = evaluations && opening.first[i] == eval(polys[i].get_poly(), z);
+  check_test(evaluations, "batch opening, evaluations");
+  
+  vector<ZZ_p> tampered = opening.first;
+  tampered[2] += 1;
+  check_test(!kzg.verify_batch_opening(commits, opening.second, z, tampered), "batch opening, refutation of a wrong value");
+  
+  swap(commits[0], commits[1]);
+  check_test(!kzg.verify_batch_opening(commits, opening.second, z, opening.first), "batch opening, refutation of reordered commits");
+}
+
+void sparse_proof_test() {
+  kzg::trusted_setup kzg(2100);
+  string data = random_string(2000);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(data));
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  vector<int> indices = { 1999, 3, 700, 41, 1200, 4 };
+  vector<uint8_t> samples;
+  for (int i : indices)
+    samples.push_back(data[i]);
+  
+  kzg::proof proof = kzg.create_proof(poly, indices);
+  kzg::blob verify = kzg::blob::from_bytes(samples.data(), indices, 1);
+  check_test(kzg.verify_proof(commit, proof, verify), "sparse proof, verification");
+  
+  vector<int> moved = indices;
+  moved[2] = 701;
+  kzg::blob refute = kzg::blob::from_bytes(samples.data(), moved, 1);
+  check_test(!kzg.verify_proof(commit, proof, refute), "sparse proof, refutation of a moved index");
+  
+  samples[4] ^= 1;
+  refute = kzg::blob::from_bytes(samples.data(), indices, 1);
+  check_test(!kzg.verify_proof(commit, proof, refute), "sparse proof, refutation of a changed chunk");
+  
+  bool exception = false;
+  try { kzg.create_proof(poly, vector<int>{ 5, 9, 5 }); }
+  catch (...) { exception = true; }
+  check_test(exception, "sparse proof, repeated index");
+}
+
+void sharded_commit_test() {
+  kzg::trusted_setup kzg(64);
+  string data = random_string(2000);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  
+  // 32 shards of 63 chunks of 1 byte, the last one shorter
+  kzg::sharded_commit commit = kzg.create_sharded_commit(bytes, data.size(), 1);
+  check_test(commit.get_shards().size() == 32, "sharded commit, shard count");
+  
+  bool verified = true;
+  for (auto w : vector<pair<int, int>>{ {0, 10}, {200, 30}, {1990, 10} }) {
+    kzg::sharded_proof proof = kzg.create_sharded_proof(commit, bytes, w.first, w.second);
+    int local_offset = w.first - commit.shard_byte_offset(proof.get_shard());
+    kzg::blob verify = kzg::blob::from_bytes(bytes + w.first, local_offset, w.second, 1);
+    verified = verified && proof.get_shard() == commit.shard_of(w.first) && kzg.verify_sharded_proof(commit.get_root(), proof, verify);
+  }
+  check_test(verified, "sharded commit, proof verification");
+  
+  kzg::sharded_proof proof = kzg.create_sharded_proof(commit, bytes, 200, 30);
+  kzg::blob verify = kzg::blob::from_bytes(bytes + 200, 200 - commit.shard_byte_offset(proof.get_shard()), 30, 1);
+  kzg::sharded_proof wrong_shard(proof.get_shard() + 1, proof.get_shard_commit(), proof.get_path(), proof.get_byte_length(), proof.get_chunk_size(), proof.get_shard_chunks(), proof.get_proof());
+  check_test(!kzg.verify_sharded_proof(commit.get_root(), wrong_shard, verify), "sharded commit, refutation of the wrong shard");
+  
+  // a valid proof of other data, checked against the root published for this data
+  string other_data = data;
+  other_data[210] ^= 1;
+  const uint8_t* other_bytes = reinterpret_cast<const uint8_t*>(other_data.data());
+  kzg::sharded_commit other = kzg.create_sharded_commit(other_bytes, other_data.size(), 1);
+  kzg::sharded_proof other_proof = kzg.create_sharded_proof(other, other_bytes, 200, 30);
+  kzg::blob other_verify = kzg::blob::from_bytes(other_bytes + 200, 200 - other.shard_byte_offset(other_proof.get_shard()), 30, 1);
+  check_test(kzg.verify_sharded_proof(other.get_root(), other_proof, other_verify)
+             && !kzg.verify_sharded_proof(commit.get_root(), other_proof, other_verify), "sharded commit, refutation against a mismatched root");
+  
+  // the other shard commitment spliced into this proof's path
+  kzg::sharded_proof spliced(proof.get_shard(), other_proof.get_shard_commit(), proof.get_path(), proof.get_byte_length(), proof.get_chunk_size(), proof.get_shard_chunks(), other_proof.get_proof());
+  check_test(!kzg.verify_sharded_proof(commit.get_root(), spliced, other_verify), "sharded commit, refutation of a substituted shard commitment");
+  
+  bool exception = false;
+  try { kzg.create_sharded_proof(commit, bytes, 60, 10); }
+  catch (...) { exception = true; }
+  check_test(exception, "sharded commit, range crossing shards");
+}
+
+void setup_file_test() {
+  kzg::trusted_setup::generate_setup_file("test_setup_stream", 300);
+  check_test(access("test_setup_stream.checkpoint", F_OK) != 0, "setup file, checkpoint removed when done");
+  
+  kzg::trusted_setup streamed("test_setup_stream");
+  string data = random_string(250);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(data));
+  kzg::commit commit = streamed.create_commit(poly);
+  kzg::proof proof = streamed.create_proof(poly, 10, 20);
+  kzg::blob expected = kzg::blob::from_string(data.substr(10, 20), 10);
+  check_test(streamed.verify_proof(commit, proof, expected), "setup file, generated setup verifies proofs");
+  
+  kzg::trusted_setup kzg(300);
+  kzg.export_setup("test_setup_export");
+  kzg::trusted_setup loaded("test_setup_export");
+  kzg::commit original_commit = kzg.create_commit(poly);
+  kzg::commit loaded_commit = loaded.create_commit(poly);
+  check_test(ECP_equals(&original_commit.get_curve_point(), &loaded_commit.get_curve_point()), "setup file, export and load round trip");
+  
+  bool exception = false;
+  try { kzg::trusted_setup::generate_setup_file("test_setup_stream", 1); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception, "setup file, num_coeff < 2 is invalid");
+  
+  remove("test_setup_stream");
+  remove("test_setup_export");
+}
+
+// Writes a checkpoint as generate_setup_file leaves it: magic, num_coeff,
+// completed blocks and the secret as a big-endian BIG, padded like the struct
+static void write_checkpoint(const char* filename, uint64_t num_coeff, uint64_t done_blocks, mode_t mode) {
+  vector<uint8_t> bytes(8 + ((2 * sizeof(uint64_t) + MODBYTES_CURVE + 7) / 8) * 8, 0);
+  memcpy(&bytes[0], "KZGCKPT1", 8);
+  memcpy(&bytes[8], &num_coeff, sizeof(num_coeff));
+  memcpy(&bytes[16], &done_blocks, sizeof(done_blocks));
+  bytes[24 + MODBYTES_CURVE - 1] = 7;
+  
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0 || write(fd, bytes.data(), bytes.size()) != (ssize_t) bytes.size() || fchmod(fd, mode) != 0)
+    cout << "could not write test checkpoint" << endl;
+  if (fd >= 0)
+    close(fd);
+}
+
+static string read_file(const char* filename) {
+  ifstream file(filename, ios::binary);
+  return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+void setup_resume_test() {
+  // two generation blocks of 4096 points, the second one a few points long
+  const uint64_t n = 4100, block = 4096;
+  const size_t G1_record = 4 + 2 * MODBYTES_CURVE + 1, G2_record = 4 + 4 * MODBYTES_CURVE + 1;
+  
+  // a checkpoint at block 0 fixes the secret, so the whole file is reproducible
+  write_checkpoint("test_setup_resume.checkpoint", n, 0, S_IRUSR | S_IWUSR);
+  kzg::trusted_setup::generate_setup_file("test_setup_resume", n);
+  string complete = read_file("test_setup_resume");
+  
+  // an interruption after the first block leaves the rest of the file unwritten
+  {
+    fstream file("test_setup_resume", ios::in | ios::out | ios::binary);
+    string G1_zeros((n - block) * G1_record, 0), G2_zeros((n - block) * G2_record, 0);
+    file.seekp(8 + block * G1_record);
+    file.write(G1_zeros.data(), G1_zeros.size());
+    file.seekp(8 + n * G1_record + block * G2_record);
+    file.write(G2_zeros.data(), G2_zeros.size());
+  }
+  write_checkpoint("test_setup_resume.checkpoint", n, 1, S_IRUSR | S_IWUSR);
+  kzg::trusted_setup::generate_setup_file("test_setup_resume", n);
+  check_test(read_file("test_setup_resume") == complete, "setup file, resume rewrites only the missing blocks");
+  check_test(access("test_setup_resume.checkpoint", F_OK) != 0, "setup file, checkpoint wiped after resuming");
+  
+  kzg::trusted_setup resumed("test_setup_resume");
+  string data = random_string(250);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(data));
+  kzg::commit commit = resumed.create_commit(poly);
+  kzg::proof proof = resumed.create_proof(poly, 30, 40);
+  kzg::blob expected = kzg::blob::from_string(data.substr(30, 40), 30);
+  check_test(resumed.verify_proof(commit, proof, expected), "setup file, resumed setup verifies proofs");
+  
+  bool wrong_size = false;
+  write_checkpoint("test_setup_resume.checkpoint", 600, 0, S_IRUSR | S_IWUSR);
+  try { kzg::trusted_setup::generate_setup_file("test_setup_resume", n); }
+  catch (const invalid_argument& e) { wrong_size = true; }
+  check_test(wrong_size, "setup file, checkpoint of another size is rejected");
+  
+  bool readable = false;
+  write_checkpoint("test_setup_resume.checkpoint", n, 0, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  try { kzg::trusted_setup::generate_setup_file("test_setup_resume", n); }
+  catch (const runtime_error& e) { readable = true; }
+  check_test(readable, "setup file, checkpoint readable by others is rejected");
+  
+  remove("test_setup_resume.checkpoint");
+  remove("test_setup_resume");
+}
+
+void eip4844_test() {
+#ifdef KZG_CURVE_BLS12381
+  kzg::eip4844::generate_setup_file("test_eip4844_setup.txt");
+  kzg::eip4844 eth("test_eip4844_setup.txt");
+  
+  // field elements with a zero top byte are always below the curve order
+  vector<vector<uint8_t>> blobs(3, vector<uint8_t>(kzg::eip4844::BYTES_PER_BLOB));
+  for (auto& blob : blobs) {
+    for (int i = 0; i < kzg::eip4844::BYTES_PER_BLOB; i++)
+      blob[i] = i % kzg::eip4844::BYTES_PER_FIELD_ELEMENT == 0 ? 0 : rand() % 256;
+  }
+  
+  vector<vector<uint8_t>> commitments, proofs;
+  for (auto& blob : blobs) {
+    commitments.push_back(eth.blob_to_commitment(blob));
+    proofs.push_back(eth.compute_blob_proof(blob, commitments.back()));
+  }
+  check_test(eth.verify_blob_proof(blobs[0], commitments[0], proofs[0]), "eip4844, blob proof verification");
+  check_test(!eth.verify_blob_proof(blobs[1], commitments[1], proofs[0]), "eip4844, blob proof refutation");
+  check_test(eth.verify_blob_proof_batch(blobs, commitments, proofs), "eip4844, batch verification");
+  swap(proofs[1], proofs[2]);
+  check_test(!eth.verify_blob_proof_batch(blobs, commitments, proofs), "eip4844, batch refutation");
+  
+  // z = 1 is the first point of the bit-reversed domain
+  vector<uint8_t> z(kzg::eip4844::BYTES_PER_FIELD_ELEMENT, 0);
+  z[31] = 1;
+  auto opening = eth.compute_proof(blobs[0], z);
+  check_test(equal(opening.second.begin(), opening.second.end(), blobs[0].begin()), "eip4844, evaluation on the domain");
+  check_test(eth.verify_proof(commitments[0], z, opening.second, opening.first), "eip4844, proof on the domain");
+  
+  vector<uint8_t> zero_blob(kzg::eip4844::BYTES_PER_BLOB, 0);
+  check_test(eth.blob_to_commitment(zero_blob)[0] == 0xc0, "eip4844, zero blob commits to infinity");
+  
+  bool exception = false;
+  blobs[0][0] = 0xff;
+  try { eth.blob_to_commitment(blobs[0]); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception, "eip4844, field element above the curve order is invalid");
+  remove("test_eip4844_setup.txt");
+#endif
+}
+
+#ifdef KZG_CURVE_BLS12381
+// Field element i of test blob k has a zero top byte and the bytes below
+// (251 i + 67 j + 13 k + 1) mod 256, the same formula generated the vectors below
+static vector<uint8_t> eip4844_test_blob(int k) {
+  vector<uint8_t> blob(kzg::eip4844::BYTES_PER_BLOB, 0);
+  for (int i = 0; i < kzg::eip4844::FIELD_ELEMENTS_PER_BLOB; i++) {
+    for (int j = 1; j < kzg::eip4844::BYTES_PER_FIELD_ELEMENT; j++)
+      blob[kzg::eip4844::BYTES_PER_FIELD_ELEMENT * i + j] = (251 * i + 67 * j + 13 * k + 1) & 0xff;
+  }
+  return blob;
+}
+#endif
+
+// Known answers under the mainnet setup (trusted_setup.txt from c-kzg-4844),
+// computed with the c-kzg-4844 reference implementation
+void eip4844_mainnet_test() {
+#ifdef KZG_CURVE_BLS12381
+  kzg::eip4844 eth("trusted_setup.txt");
+  
+  vector<vector<uint8_t>> blobs = { eip4844_test_blob(0), eip4844_test_blob(1), eip4844_test_blob(2) };
+  vector<vector<uint8_t>> commitments = {
+    from_hex("a5f35ebbf2e1b3d6693223683a1a1ec2857683a78fc4dfac0f9481f091e9bc3c862ccefd734a7a3b7557ab757b27cec8"),
+    from_hex("88e80560832179f5d42448ec8ad29e74fb0d98cdc3599ef3c8dafee8f35f19d8d65a075c478a4d670f1b7eb7ccf3c036"),
+    from_hex("8fe6dc8ade6d2c602aff9b268ee62614d8b641833fb516197a1b628d3007c476b261a3f1c601ca8065951b18638077ef")
+  };
+  vector<vector<uint8_t>> proofs = {
+    from_hex("916e3d655ef900cb590e1ba307c82a5cbfff5f0dcadf031800052752d04dc8f9cad94d5945baa623e7e87d12ea4826a8"),
+    from_hex("93bbf4e38e9fbcdef8a94460f88112053680b4a476de815724b3347e55351e0dfdd25bb322e72b543cfe09efc483f4e9"),
+    from_hex("b3412b5de8cfa896da309bd30381c587d4e3672b71b2a1b4da8d5c92887ab8acc21e63b51f6f70921f2722cabd5fb2ca")
+  };
+  
+  bool commits = true;
+  for (int k = 0; k < 3; k++)
+    commits = commits && eth.blob_to_commitment(blobs[k]) == commitments[k];
+  vector<uint8_t> zero_blob(kzg::eip4844::BYTES_PER_BLOB, 0);
+  vector<uint8_t> infinity = from_hex("c00000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000");
+  commits = commits && eth.blob_to_commitment(zero_blob) == infinity;
+  check_test(commits, "eip4844 mainnet, blob_to_kzg_commitment");
+  
+  vector<uint8_t> challenge = from_hex("30680554d9d9e5c9059e20327d186bd643d4840250b0a768c3ece7dcdb5d945b");
+  check_test(eth.compute_challenge(blobs[0], commitments[0]) == challenge, "eip4844 mainnet, compute_challenge");
+  
+  bool blob_proofs = true;
+  for (int k = 0; k < 3; k++)
+    blob_proofs = blob_proofs && eth.compute_blob_proof(blobs[k], commitments[k]) == proofs[k];
+  check_test(blob_proofs, "eip4844 mainnet, compute_blob_kzg_proof");
+  
+  vector<uint8_t> z = from_hex("5eb7004fe57383e6c88b99d839937fddf3f99279353aaf8d5c9a75f91ce33c62");
+  vector<uint8_t> y = from_hex("1c06cb5a55af5e26ef37005910d9899cfc232d6efb284349b63b95dc41ae368d");
+  vector<uint8_t> z_proof = from_hex("b61bccb92293da35ca60de9aed080b5776da0345f3699525ec757e200c570cd2f7416a779015345bcbe05ebd4577e18e");
+  auto opening = eth.compute_proof(blobs[0], z);
+  check_test(opening.first == z_proof && opening.second == y, "eip4844 mainnet, compute_kzg_proof");
+  vector<uint8_t> wrong_y = y;
+  wrong_y[31] ^= 1;
+  check_test(eth.verify_proof(commitments[0], z, y, z_proof) && !eth.verify_proof(commitments[0], z, wrong_y, z_proof),
+             "eip4844 mainnet, verify_kzg_proof accepts and rejects");
+  
+  check_test(eth.verify_blob_proof(blobs[0], commitments[0], proofs[0]) && !eth.verify_blob_proof(blobs[1], commitments[1], proofs[0]),
+             "eip4844 mainnet, verify_blob_kzg_proof accepts and rejects");
+  
+  vector<vector<uint8_t>> swapped = { proofs[0], proofs[2], proofs[1] };
+  vector<vector<uint8_t>> none;
+  check_test(eth.verify_blob_proof_batch(blobs, commitments, proofs) && !eth.verify_blob_proof_batch(blobs, commitments, swapped)
+             && eth.verify_blob_proof_batch(none, none, none), "eip4844 mainnet, verify_blob_kzg_proof_batch accepts and rejects");
+  
+  // inputs the reference implementation returns an error for
+  vector<uint8_t> off_curve = from_hex("8123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+  vector<uint8_t> non_canonical = blobs[0];
+  non_canonical[0] = 0xff;
+  int errors = 0;
+  try { eth.verify_blob_proof(blobs[0], off_curve, proofs[0]); }
+  catch (const invalid_argument& e) { errors++; }
+  try { eth.verify_blob_proof(non_canonical, commitments[0], proofs[0]); }
+  catch (const invalid_argument& e) { errors++; }
+  try { eth.blob_to_commitment(non_canonical); }
+  catch (const invalid_argument& e) { errors++; }
+  try { eth.verify_blob_proof_batch(blobs, commitments, none); }
+  catch (const invalid_argument& e) { errors++; }
+  check_test(errors == 4, "eip4844 mainnet, invalid points and field elements are errors");
+#endif
+}
+
+void shared_setup_test() {
+  string name = "kzg_test_" + to_string(getpid());
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(random_string(100)));
+  kzg::trusted_setup kzg(120);
+  vector<uint8_t> digest = kzg.publish_shared(name);
+  kzg::commit commit = kzg.create_commit(poly);
+  check_test(digest == kzg.digest() && digest != kzg::trusted_setup(120).digest(), "shared setup, digest identifies the setup");
+  
+  kzg::trusted_setup attached = kzg::trusted_setup::attach_shared(name, digest);
+  kzg::commit attached_commit = attached.create_commit(poly);
+  check_test(ECP_equals(&commit.get_curve_point(), &attached_commit.get_curve_point()), "shared setup, attached setup commits");
+  
+  bool exception = false;
+  try { kzg::trusted_setup::attach_shared(name, kzg::trusted_setup(120).digest()); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "shared setup, another setup's digest is rejected");
+  
+  // the segment made writable by others, as a planted one could be
+  string path = "/dev/shm/" + name;
+  chmod(path.c_str(), 0666);
+  exception = false;
+  try { kzg::trusted_setup::attach_shared(name, digest); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "shared setup, segment writable by others is rejected");
+  kzg::trusted_setup::unlink_shared(name);
+  
+  exception = false;
+  try { kzg::trusted_setup::attach_shared(name, digest); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "shared setup, attaching after unlink fails");
+}
+
+void verify_proofs_test() {
+  kzg::trusted_setup kzg(200);
+  vector<string> data = { random_string(150), random_string(150) };
+  vector<pair<int, int>> windows = { {0, 4}, {10, 4}, {10, 4}, {50, 1}, {100, 20} };
+  
+  vector<kzg::commit> commits;
+  vector<kzg::proof> proofs;
+  vector<kzg::blob> expected;
+  for (size_t i = 0; i < windows.size(); i++) {
+    kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(data[i % 2]));
+    commits.push_back(kzg.create_commit(poly));
+    proofs.push_back(kzg.create_proof(poly, windows[i].first, windows[i].second));
+    expected.push_back(kzg::blob::from_string(data[i % 2].substr(windows[i].first, windows[i].second), windows[i].first));
+  }
+  
+  vector<bool> results = kzg.verify_proofs(commits, proofs, expected);
+  check_test(count(results.begin(), results.end(), true) == (int) windows.size(), "verify proofs, batch of valid proofs");
+  
+  // records 1 and 2 share a window but open different data
+  swap(proofs[1], proofs[2]);
+  results = kzg.verify_proofs(commits, proofs, expected);
+  check_test(results[0] && !results[1] && !results[2] && results[3] && results[4], "verify proofs, invalid proofs are found");
+}
+
+void poly_cache_test() {
+  kzg::trusted_setup kzg(150);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(random_string(120)));
+  kzg::poly other = kzg::poly::from_blob(kzg::blob::from_string(random_string(120)));
+  kzg::commit commit = kzg.create_commit(poly);
+  kzg::commit other_commit = kzg.create_commit(other);
+  
+  poly.save_cache("test_poly_cache", commit, kzg);
+  kzg::poly loaded = kzg::poly::load_cache("test_poly_cache", commit, kzg);
+  check_test(loaded.get_poly() == poly.get_poly(), "poly cache, round trip");
+  
+  bool exception = false;
+  try { kzg::poly::load_cache("test_poly_cache", other_commit, kzg); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "poly cache, keyed by commitment");
+  
+  exception = false;
+  try { other.save_cache("test_poly_cache_other", commit, kzg); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception && access("test_poly_cache_other", F_OK) != 0, "poly cache, saving under another commitment is invalid");
+  
+  // the other polynomial's cache with this commitment's key copied over its
+  // own, up to the digest, passes every check but the commitment
+  other.save_cache("test_poly_cache_other", other_commit, kzg);
+  {
+    fstream forged("test_poly_cache_other", ios::in | ios::out | ios::binary);
+    ifstream original("test_poly_cache", ios::binary);
+    vector<char> header(24 + MODBYTES_CURVE + commit.serialize().size());
+    original.read(header.data(), header.size());
+    forged.seekp(0);
+    forged.write(header.data(), header.size());
+  }
+  exception = false;
+  try { kzg::poly::load_cache("test_poly_cache_other", commit, kzg); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "poly cache, coefficients must match the commitment");
+  
+  fstream file("test_poly_cache", ios::in | ios::out | ios::binary);
+  file.seekp(-1, ios::end);
+  file.put(0x5a);
+  file.close();
+  exception = false;
+  try { kzg::poly::load_cache("test_poly_cache", commit, kzg); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "poly cache, corruption is detected");
+  
+  remove("test_poly_cache");
+  remove("test_poly_cache_other");
+}
+
+void extension_test() {
+  kzg::trusted_setup kzg(100);
+  kzg::blob data = kzg::blob::from_string(random_string(60));
+  kzg::poly poly = kzg::poly::from_blob(data);
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  kzg::blob extended = kzg::blob::extend(poly, 60);
+  auto& points = extended.get_data();
+  check_test(points.size() == 120 && equal(data.get_data().begin(), data.get_data().end(), points.begin()), "extension, data is a prefix of the extension");
+  
+  // 15 cells of 8 points
+  vector<kzg::proof> proofs = kzg.create_cell_proofs(poly, 60, 8);
+  vector<kzg::blob> cells;
+  for (int i = 0; i < 15; i++) {
+    vector<pair<ZZ_p, ZZ_p>> cell(points.begin() + 8 * i, points.begin() + 8 * (i + 1));
+    cells.push_back(kzg::blob(cell));
+  }
+  check_test(proofs.size() == 15 && kzg.verify_proof(commit, proofs[12], cells[12]), "extension, cell proof verifies");
+  check_test(!kzg.verify_proof(commit, proofs[11], cells[12]), "extension, cell proof refutes another cell");
+  
+  // bulk proofs match per-cell create_proof, with and without a fixed-base table
+  bool matches = true;
+  kzg::trusted_setup fixed = kzg;
+  fixed.precompute_G1(16);
+  for (kzg::trusted_setup* setup : { &kzg, &fixed }) {
+    for (int cell_size : { 1, 8, 40 }) {
+      vector<kzg::proof> bulk = setup->create_cell_proofs(poly, 60, cell_size);
+      matches = matches && bulk.size() == (size_t) 120 / cell_size;
+      for (size_t i = 0; matches && i < bulk.size(); i++) {
+        kzg::proof single = kzg.create_proof(poly, i * cell_size, cell_size);
+        matches = ECP_equals(&bulk[i].get_curve_point(), &single.get_curve_point());
+      }
+    }
+  }
+  check_test(matches, "extension, cell proofs match create_proof");
+  
+  vector<kzg::blob> upper(cells.begin() + 7, cells.end());
+  check_test(kzg::poly::recover(upper, 60).get_poly() == poly.get_poly(), "extension, recovery from half of the cells");
+  
+  bool exception = false;
+  vector<kzg::blob> too_few(cells.begin() + 8, cells.end());
+  try { kzg::poly::recover(too_few, 60); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception, "extension, recovery needs half of the cells");
+}
+
+void vartime_test() {
+  kzg::trusted_setup kzg(40);
+  
+  // constant polynomials commit to c * G, checked against the constant-time path
+  bool matches = true;
+  for (long c : { 0L, 1L, 2L, 7L, 255L, 65537L, -1L, -255L }) {
+    ZZ_pX P;
+    SetCoeff(P, 0, conv<ZZ_p>(c));
+    kzg::commit commit = kzg.create_commit(kzg::poly(P));
+    
+    BIG e;
+    BIG_zero(e);
+    if (c < 0) {
+      BIG_rcopy(e, CURVE_Order);
+      BIG_dec(e, -c);
+    } else {
+      BIG_inc(e, c);
+    }
+    BIG_norm(e);
+    ECP expected;
+    ECP_generator(&expected);
+    PAIR_G1mul(&expected, e);
+    matches = matches && ECP_equals(&commit.get_curve_point(), &expected);
+  }
+  check_test(matches, "vartime, small and negated scalars");
+  
+  // mixed zero, small and full-size coefficients through both msm kernels
+  ZZ_pX P;
+  for (int i = 0; i < 30; i++)
+    SetCoeff(P, i, i % 3 == 0 ? conv<ZZ_p>(0) : i % 3 == 1 ? conv<ZZ_p>(i) : random_ZZ_p());
+  kzg::poly poly(P);
+  kzg::profile saved = kzg::PROFILE;
+  kzg::PROFILE.msm_g1_threshold = INT_MAX;
+  kzg::commit naive = kzg.create_commit(poly);
+  kzg::PROFILE.msm_g1_threshold = 1;
+  kzg::commit bucket = kzg.create_commit(poly);
+  kzg::PROFILE = saved;
+  check_test(ECP_equals(&naive.get_curve_point(), &bucket.get_curve_point()), "vartime, naive and signed bucket msm agree");
+  
+  auto opening = kzg.create_opening(poly, conv<ZZ_p>(1000));
+  check_test(kzg.verify_opening(naive, opening.second, conv<ZZ_p>(1000), opening.first), "vartime, opening verifies");
+}
+
+void packed_blob_test() {
+  kzg::trusted_setup kzg(20);
+  string data = random_string(10 * MAX_CHUNK_BYTES + 5);
+  kzg::blob packed = kzg::blob::from_string_packed(data);
+  
+  // the short last chunk encodes as if zero padded
+  vector<uint8_t> padded(data.begin(), data.end());
+  padded.resize(11 * MAX_CHUNK_BYTES, 0);
+  kzg::blob manual = kzg::blob::from_bytes(padded.data(), 0, padded.size(), MAX_CHUNK_BYTES);
+  check_test(packed.get_data().size() == 11 && packed.get_data() == manual.get_data(), "packed blob, matches manual padding");
+  
+  // bytes 40..99 lie in chunks 1..3
+  auto window = kzg::blob::chunk_window(40, 60);
+  check_test(window.first == 40 / MAX_CHUNK_BYTES && window.second == 99 / MAX_CHUNK_BYTES - window.first + 1, "packed blob, byte range to chunk window");
+  
+  // offsets past INT_MAX chunks would wrap to negative windows
+  int rejected = 0;
+  uint64_t far = (uint64_t) INT_MAX * MAX_CHUNK_BYTES;
+  for (auto range : vector<pair<uint64_t, uint64_t>>{ { far, 1 }, { 0, far + 1 }, { UINT64_MAX, 2 } }) {
+    try { kzg::blob::chunk_window(range.first, range.second); }
+    catch (const invalid_argument& e) { rejected++; }
+  }
+  auto edge = kzg::blob::chunk_window(far - 1, 1);
+  check_test(rejected == 3 && edge.first == INT_MAX - 1 && edge.second == 1, "packed blob, chunk windows past INT_MAX are rejected");
+  
+  kzg::poly poly = kzg::poly::from_blob(packed);
+  kzg::commit commit = kzg.create_commit(poly);
+  auto last = kzg::blob::chunk_window(data.size() - 20, 20);
+  kzg::proof proof = kzg.create_proof(poly, last.first, last.second);
+  kzg::blob tail = kzg::blob::from_string_packed(data.substr(last.first * MAX_CHUNK_BYTES), last.first);
+  check_test(kzg.verify_proof(commit, proof, tail), "packed blob, proof over the partial chunk");
+}
+
+void create_commits_test() {
+  kzg::trusted_setup kzg(80);
+  vector<kzg::poly> polys;
+  for (int i = 0; i < 70; i++)
+    polys.push_back(kzg::poly::from_blob(kzg::blob::from_string(random_string(1 + (i * 7) % 70))));
+  polys.push_back(kzg::poly(ZZ_pX()));
+  
+  // small polynomials take the per-term path, forcing buckets covers the batch kernel
+  bool matches = true;
+  kzg::profile saved = kzg::PROFILE;
+  for (int threshold : { INT_MAX, 1 }) {
+    kzg::PROFILE.msm_g1_threshold = threshold;
+    vector<kzg::commit> commits = kzg.create_commits(polys);
+    matches = matches && commits.size() == polys.size();
+    for (size_t i = 0; matches && i < polys.size(); i++)
+      matches = kzg.verify_commit(commits[i], polys[i]);
+  }
+  kzg::PROFILE = saved;
+  check_test(matches, "create commits, matches create_commit");
+  
+  kzg::trusted_setup fixed = kzg;
+  fixed.precompute_G1(16);
+  matches = true;
+  for (int threshold : { INT_MAX, 1 }) {
+    kzg::PROFILE.msm_g1_threshold = threshold;
+    vector<kzg::commit> commits = fixed.create_commits(polys);
+    for (size_t i = 0; matches && i < polys.size(); i++)
+      matches = kzg.verify_commit(commits[i], polys[i]);
+  }
+  kzg::PROFILE = saved;
+  check_test(matches, "create commits, fixed-base table");
+}
+
+void precompute_test() {
+  kzg::trusted_setup kzg(120);
+  kzg::poly poly = kzg::poly::from_blob(kzg::blob::from_string(random_string(100)));
+  kzg::commit expected = kzg.create_commit(poly);
+  kzg::proof expected_proof = kzg.create_proof(poly, 10, 5);
+  
+  bool matches = true;
+  for (int stride : { 2, 13, 64, 300 }) {
+    kzg::trusted_setup fixed = kzg;
+    fixed.precompute_G1(stride);
+    kzg::commit commit = fixed.create_commit(poly);
+    kzg::proof proof = fixed.create_proof(poly, 10, 5);
+    matches = matches && ECP_equals(&commit.get_curve_point(), &expected.get_curve_point())
+                      && ECP_equals(&proof.get_curve_point(), &expected_proof.get_curve_point());
+  }
+  check_test(matches, "precompute, fixed-base commits and proofs match");
+  
+  kzg::trusted_setup fixed = kzg;
+  fixed.precompute_G1(32);
+  fixed.save_precomputed("test_precomputed");
+  kzg::trusted_setup loaded = kzg;
+  loaded.load_precomputed("test_precomputed");
+  kzg::commit commit = loaded.create_commit(poly);
+  check_test(ECP_equals(&commit.get_curve_point(), &expected.get_curve_point()), "precompute, save and load");
+  
+  // the header is little-endian whatever the host: point size, then stride
+  {
+    ifstream file("test_precomputed", ios::binary);
+    char header[16];
+    file.read(header, sizeof(header));
+    int point_size = 2 * MODBYTES_CURVE;
+    check_test(file && memcmp(header, "KZGPRE03", 8) == 0
+               && (uint8_t) header[8] == (point_size & 0xff) && (uint8_t) header[9] == (point_size >> 8)
+               && header[12] == 32 && header[13] == 0 && header[14] == 0 && header[15] == 0,
+               "precompute, saved header is little-endian");
+  }
+  
+  bool exception = false;
+  kzg::trusted_setup other(120);
+  try { other.load_precomputed("test_precomputed"); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "precompute, table is tied to its setup");
+  
+  // the last entry is a shifted copy, not covered by comparing with the setup
+  {
+    fstream file("test_precomputed", ios::in | ios::out | ios::binary);
+    file.seekp(-3, ios::end);
+    file.put(0x5a);
+  }
+  exception = false;
+  try { loaded.load_precomputed("test_precomputed"); }
+  catch (const runtime_error& e) { exception = true; }
+  check_test(exception, "precompute, damaged table is detected");
+  
+  remove("test_precomputed");
+}
+
+void psi_msm_test() {
+  // without the verify cache every check computes Z in G2
+  kzg::profile saved = kzg::PROFILE;
+  kzg::PROFILE.verify_cache_size = 0;
+  kzg::trusted_setup kzg(200);
+  kzg::workspace workspace;
+  kzg::blob data = kzg::blob::from_string(random_string(180));
+  kzg::poly poly = kzg::poly::from_blob(data);
+  kzg::commit commit = kzg.create_commit(poly);
+  
+  // windows of these sizes put Z through both G2 kernels after the split
+  bool verified = true, refuted = true;
+  for (int threshold : { INT_MAX, 1 }) {
+    kzg::PROFILE.msm_g2_threshold = threshold;
+    for (int length : { 1, 2, 7, 40, 150 }) {
+      kzg::proof proof = kzg.create_proof(poly, 20, length);
+      vector<pair<ZZ_p, ZZ_p>> window(data.get_data().begin() + 20, data.get_data().begin() + 20 + length);
+      kzg::blob expected(window);
+      verified = verified && kzg.verify_proof(commit, proof, expected, workspace);
+      
+      window.back().second += 1;
+      kzg::blob tampered(window);
+      refuted = refuted && !kzg.verify_proof(commit, proof, tampered, workspace);
+    }
+  }
+  kzg::PROFILE = saved;
+  check_test(verified, "psi msm, proofs verify through both kernels");
+  check_test(refuted, "psi msm, tampered windows are refuted");
+}
+
+void batch_inverse_test() {
+  // scattered x coordinates take the Z' evaluation path, consecutive ones the factorial weights
+  bool fits = true;
+  kzg::profile saved = kzg::PROFILE;
+  for (int threshold : { INT_MAX, 4 }) {
+    kzg::PROFILE.fast_multieval_threshold = threshold;
+    for (bool consecutive : { false, true }) {
+      vector<pair<ZZ_p, ZZ_p>> points;
+      for (int i = 0; i < 37; i++)
+        points.push_back({ conv<ZZ_p>(consecutive ? 5 + i : 3 * i * i + 1), random_ZZ_p() });
+      kzg::blob blob(points);
+      ZZ_pX P = kzg::poly::from_blob(blob).get_poly();
+      fits = fits && deg(P) < 37;
+      for (auto& point : points)
+        fits = fits && eval(P, point.first) == point.second;
+    }
+  }
+  kzg::PROFILE = saved;
+  check_test(fits, "batch inverse, interpolation fits every point");
+  
+  bool exception = false;
+  vector<pair<ZZ_p, ZZ_p>> repeated = { { conv<ZZ_p>(2), conv<ZZ_p>(1) }, { conv<ZZ_p>(9), conv<ZZ_p>(4) }, { conv<ZZ_p>(2), conv<ZZ_p>(3) } };
+  kzg::blob blob(repeated);
+  try { kzg::poly::from_blob(blob); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception, "batch inverse, repeated x coordinates are rejected");
+}
+
+void consecutive_domain_test() {
+  // windows long enough to recurse past the Horner blocks, split across threads
+  kzg::profile saved = kzg::PROFILE;
+  kzg::PROFILE.num_threads = 4;
+  kzg::PROFILE.parallel_grain = 64;
+  kzg::PROFILE.fast_multieval_threshold = 0;
+  
+  bool fits = true;
+  for (int length : { 1, 33, 300 }) {
+    vector<pair<ZZ_p, ZZ_p>> points;
+    for (int i = 0; i < length; i++)
+      points.push_back({ conv<ZZ_p>(11 + i), random_ZZ_p() });
+    kzg::blob blob(points);
+    ZZ_pX P = kzg::poly::from_blob(blob).get_poly();
+    fits = fits && deg(P) < length;
+    for (auto& point : points)
+      fits = fits && eval(P, point.first) == point.second;
+  }
+  check_test(fits, "consecutive domain, interpolation fits every point");
+  
+  bool exception = false;
+  vector<pair<ZZ_p, ZZ_p>> no_points;
+  kzg::blob empty(no_points);
+  try { kzg::poly::from_blob(empty); }
+  catch (const invalid_argument& e) { exception = true; }
+  check_test(exception, "consecutive domain, empty blob is rejected");
+  
+  ZZ_pX P = random_ZZ_pX(250);
+  kzg::blob extended = kzg::blob::extend(kzg::poly(P), 250);
+  bool evaluates = extended.get_data().size() == 500;
+  for (auto& point : extended.get_data())
+    evaluates = evaluates && eval(P, point.first) == point.second;
+  check_test(evaluates, "consecutive domain, evaluation matches Horner");
+  
+  // degrees 2^k - 1 fill the falling factorial table exactly, and a nonzero
+  // offset goes through the Taylor shift before the basis change
+  bool shifted = true;
+  for (long degree : { 63L, 255L, 256L, 1023L }) {
+    ZZ_pX Q = random_ZZ_pX(degree + 1);
+    SetCoeff(Q, degree, random_ZZ_p() + 1);
+    for (int offset : { 0, 1, 4097 }) {
+      for (int length : { 1, (int) degree + 1, 300 }) {
+        vector<ZZ_p> values(length);
+        evaluate_consecutive(values.data(), Q, offset, length, 4);
+        for (int j = 0; j < length; j++)
+          shifted = shifted && values[j] == eval(Q, conv<ZZ_p>(offset + j));
+      }
+    }
+  }
+  check_test(shifted, "consecutive domain, shifted evaluation at degrees 2^k - 1 matches Horner");
+  
+  kzg::trusted_setup kzg(400);
+  kzg::poly poly(P);
+  kzg::commit commit = kzg.create_commit(poly);
+  kzg::proof proof = kzg.create_proof(poly, 40, 150);
+  vector<pair<ZZ_p, ZZ_p>> window(extended.get_data().begin() + 40, extended.get_data().begin() + 190);
+  kzg::blob expected(window);
+  bool verified = kzg.verify_proof(commit, proof, expected);
+  window[75].second += 1;
+  kzg::blob tampered(window);
+  bool refuted = !kzg.verify_proof(commit, proof, tampered);
+  kzg::PROFILE = saved;
+  check_test(verified && refuted, "consecutive domain, window proofs verify against the shifted falling factorial");
+}
+
+void field_test() {
+  // random values plus the edges 0, 1 and r - 1, checked against NTL
+  vector<ZZ_p> values = { conv<ZZ_p>(0), conv<ZZ_p>(1), conv<ZZ_p>(-1) };
+  for (int i = 0; i < 50; i++)
+    values.push_back(random_ZZ_p());
+  
+  bool arithmetic = true;
+  for (auto& a : values) {
+    fr fa, fb, fc;
+    fr_from_ZZ_p(fa, a);
+    for (auto& b : values) {
+      ZZ_p c;
+      fr_from_ZZ_p(fb, b);
+      fr_mul(fc, fa, fb);
+      fr_to_ZZ_p(c, fc);
+      arithmetic = arithmetic && c == a * b;
+      fr_add(fc, fa, fb);
+      fr_to_ZZ_p(c, fc);
+      arithmetic = arithmetic && c == a + b;
+      fr_sub(fc, fa, fb);
+      fr_to_ZZ_p(c, fc);
+      arithmetic = arithmetic && c == a - b;
+    }
+  }
+  check_test(arithmetic, "field, mul, add and sub match NTL");
+  
+  bool powers = true;
+  for (auto& a : values) {
+    fr fa, fr_res;
+    fr_from_ZZ_p(fa, a);
+    
+    ZZ e = RandomBits_ZZ(64 * FR_LIMBS);
+    uint64_t limbs[FR_LIMBS];
+    limbs_from_ZZ(limbs, e);
+    fr_pow(fr_res, fa, limbs, FR_LIMBS);
+    ZZ_p res;
+    fr_to_ZZ_p(res, fr_res);
+    powers = powers && res == power(a, e);
+    
+    if (!IsZero(a)) {
+      fr_inv(fr_res, fa);
+      fr_to_ZZ_p(res, fr_res);
+      powers = powers && res == inv(a);
+    }
+  }
+  check_test(powers, "field, pow and inv match NTL");
+  
+  vector<ZZ_p> nonzero(values.begin() + 1, values.end());
+  fr_vec batch;
+  fr_vec_from_ZZ_p(batch, nonzero.data(), nonzero.size());
+  fr_batch_inv(batch, batch);
+  bool inverses = true;
+  for (size_t i = 0; i < nonzero.size(); i++) {
+    ZZ_p res;
+    fr_to_ZZ_p(res, batch[i]);
+    inverses = inverses && res == inv(nonzero[i]);
+  }
+  check_test(inverses, "field, batch inverse matches NTL");
+  
+  // whole-array operations, the result overwriting an operand
+  size_t n = values.size();
+  vector<ZZ_p> others(n), expected(n), actual(n);
+  for (size_t i = 0; i < n; i++)
+    others[i] = values[n - 1 - i];
+  fr_vec a, b, c;
+  fr_vec_from_ZZ_p(a, values.data(), n);
+  fr_vec_from_ZZ_p(b, others.data(), n);
+  fr s;
+  fr_from_ZZ_p(s, values[5]);
+  
+  c = a;
+  fr_batch_add(c, c, b);
+  fr_batch_mul(c, c, b);
+  fr_batch_sub(c, c, a);
+  fr_batch_scale(c, c, s);
+  fr_vec_to_ZZ_p(actual.data(), c);
+  ZZ_p sum;
+  for (size_t i = 0; i < n; i++) {
+    expected[i] = ((values[i] + others[i]) * others[i] - values[i]) * values[5];
+    sum += expected[i];
+  }
+  fr res;
+  ZZ_p sum_res, horner_res;
+  fr_sum(res, c);
+  fr_to_ZZ_p(sum_res, res);
+  fr_horner(res, a, s);
+  fr_to_ZZ_p(horner_res, res);
+  ZZ_pX P;
+  for (size_t i = 0; i < n; i++)
+    SetCoeff(P, i, values[i]);
+  check_test(actual == expected && sum_res == sum && horner_res == eval(P, values[5]), "field, whole-array operations match NTL");
+  
+  fr_vec shorter(b.begin(), b.end() - 1);
+  int rejected = 0;
+  try { fr_batch_add(c, a, shorter); } catch (const invalid_argument& e) { rejected++; }
+  try { fr_batch_sub(c, shorter, a); } catch (const invalid_argument& e) { rejected++; }
+  try { fr_batch_mul(c, a, shorter); } catch (const invalid_argument& e) { rejected++; }
+  check_test(rejected == 3, "field, whole-array operands of different sizes are rejected");
+}
+
 void general_test(int num_coeff, string data, vector<pair<int, int>> to_verify, vector<tuple<int, int, string>> to_refute, bool to_serialize) {
   bool success = true;
   kzg::trusted_setup kzg(num_coeff);